@@ -20,14 +20,37 @@
 #include "common.h"
 #include "fvec.h"
 #include "fmath.h"
+#include "fwindow.h"
 #include "util.h"
 #include "input.h"
+#include "sally.h"
 
 /**< Weights for TFIDF normalization */
 static fvec_t *idf_weights = NULL;
+/**< Weights for TFIDF normalization indexed by dimension */
+static float *idf_table = NULL;
+/**< Length of the table of IDF weights */
+static feat_t idf_table_len = 0;
+/**< Spill file for single-pass TFIDF weighting */
+static gzFile spill_z = NULL;
+/**< Descriptor of spill file */
+static int spill_fd = -1;
+/**< Document frequencies of the current run */
+static fvec_t *df_run = NULL;
+/**< Number of documents in the current run */
+static uint64_t df_run_docs = 0;
+/**< Store of document frequencies: dimensions */
+static feat_t *df_dim = NULL;
+/**< Store of document frequencies: counts */
+static uint64_t *df_cnt = NULL;
+/**< Store of document frequencies: length and number of documents */
+static uint64_t df_len = 0, df_docs = 0;
 /**< Global configuration */
 extern config_t cfg;
 
+/* Local functions */
+static void idf_finish(long entries);
+
 /**
  * Embeds a feature vector using a given normalization.
  * @param fv Feature vector
@@ -63,6 +86,487 @@ void fvec_embed(fvec_t *fv, const char *n)
 }
 
 
+/**
+ * Sums the values of a feature vector for normalization. Depending on
+ * the norm, absolute or squared values are summed. The loops are kept
+ * free of branches, such that they can be vectorized.
+ * @param val Array of values
+ * @param len Length of array
+ * @param norm Normalization mode
+ * @return sum of values
+ */
+static double norm_sum(float *val, unsigned long len, int norm)
+{
+    unsigned long i;
+    double s = 0;
+
+    if (norm == NORM_L1) {
+#ifdef HAVE_OPENMP
+#pragma omp simd reduction(+:s)
+#endif
+        for (i = 0; i < len; i++)
+            s += fabs(val[i]);
+    } else if (norm == NORM_L2) {
+#ifdef HAVE_OPENMP
+#pragma omp simd reduction(+:s)
+#endif
+        for (i = 0; i < len; i++)
+            s += (double) val[i] * val[i];
+    }
+
+    return s;
+}
+
+/**
+ * Multiplies the values of a feature vector with the IDF weights and
+ * sums the values for normalization in the same pass. Values of
+ * dimensions without weight are set to zero. If a table of weights is
+ * available, each weight is gathered by its dimension. Otherwise, the
+ * weights are searched, where the binary search continues from the last
+ * match, as the dimensions of the vector are sorted.
+ * @param fv Feature vector
+ * @param norm Normalization mode
+ * @param tf Sum of values before weighting (term frequency)
+ * @return sum of weighted values
+ */
+static double idf_times(fvec_t *fv, int norm, double *tf)
+{
+    unsigned long i, p = 0, q, k;
+    feat_t *dim = idf_weights->dim;
+    double t = 0, s1 = 0, s2 = 0;
+
+    if (idf_table) {
+#ifdef HAVE_OPENMP
+#pragma omp simd reduction(+:t,s1,s2)
+#endif
+        for (i = 0; i < fv->len; i++) {
+            feat_t d = fv->dim[i];
+            float v = fv->val[i];
+
+            t += fabs(v);
+            /* Dimensions of a growing dictionary may exceed the table */
+            v *= d < idf_table_len ? idf_table[d] : 0;
+            fv->val[i] = v;
+            s1 += fabs(v);
+            s2 += (double) v * v;
+        }
+    } else {
+        for (i = 0; i < fv->len; i++) {
+            float v = fv->val[i];
+
+            /* Binary search for first weight not smaller than dimension */
+            q = idf_weights->len;
+            while (p < q) {
+                k = p + ((q - p) >> 1);
+                if (dim[k] < fv->dim[i])
+                    p = k + 1;
+                else
+                    q = k;
+            }
+
+            t += fabs(v);
+            if (p < idf_weights->len && dim[p] == fv->dim[i])
+                v *= idf_weights->val[p];
+            else
+                v = 0.0;
+            fv->val[i] = v;
+            s1 += fabs(v);
+            s2 += (double) v * v;
+        }
+    }
+
+    *tf = t;
+    if (norm == NORM_L1)
+        return s1;
+    if (norm == NORM_L2)
+        return s2;
+    return 0;
+}
+
+/**
+ * Expands the IDF weights to a table indexed by dimension. The table
+ * is only created if the feature space spans at most IDF_TABLE_BITS
+ * bits. It is read-only after creation and shared by all threads.
+ */
+static void idf_table_create()
+{
+    cfg_int bits;
+    unsigned long i;
+
+    config_lookup_int(&cfg, "features.hash_bits", &bits);
+    if (!idf_weights || bits > IDF_TABLE_BITS)
+        return;
+
+    idf_table_len = (feat_t) 1 << bits;
+
+    /* Check for weights outside of the feature space */
+    if (idf_weights->len > 0 &&
+        idf_weights->dim[idf_weights->len - 1] >= idf_table_len) {
+        warning("IDF weights do not match hash bits. Skipping table.");
+        return;
+    }
+
+    idf_table = calloc(idf_table_len, sizeof(float));
+    if (!idf_table) {
+        error("Could not allocate table of IDF weights");
+        return;
+    }
+
+    for (i = 0; i < idf_weights->len; i++)
+        idf_table[idf_weights->dim[i]] = idf_weights->val[i];
+}
+
+/**
+ * Embeds, normalizes and thresholds a feature vector in one go. This
+ * fused kernel replaces consecutive calls to fvec_embed(), fvec_norm()
+ * and fvec_thres(). A first pass computes the embedding together with
+ * the sums for the term frequency and the normalization, a second pass
+ * scales the values, applies the thresholds and compacts the vector in
+ * place. The memory of the vector is not reallocated.
+ * @param fv Feature vector
+ * @param e Embedding mode
+ * @param n Normalization mode
+ * @param tl Minimum threshold (0 = disabled)
+ * @param th Maximum threshold (0 = disabled)
+ */
+void fvec_embed_norm(fvec_t *fv, const char *e, const char *n, double tl,
+                     double th)
+{
+    unsigned long i, j;
+    double s = 0, tf = 1.0, scale = 1.0;
+    int norm;
+
+    /* No features, no embedding :( */
+    if (fv->len == 0)
+        return;
+
+    if (!strcasecmp(n, "none")) {
+        norm = NORM_NONE;
+    } else if (!strcasecmp(n, "l1")) {
+        norm = NORM_L1;
+    } else if (!strcasecmp(n, "l2")) {
+        norm = NORM_L2;
+    } else {
+        warning("Unknown normalization mode '%s', using 'none'.", n);
+        norm = NORM_NONE;
+    }
+
+    /* First pass: embedding and sums for normalization */
+    if (!strcasecmp(e, "bin")) {
+        for (i = 0; i < fv->len; i++)
+            fv->val[i] = 1;
+        /* Absolute and squared values are all one */
+        s = norm != NORM_NONE ? fv->len : 0;
+    } else if (!strcasecmp(e, "tfidf")) {
+        /* Frequencies are applied as factor in the second pass */
+        assert(idf_weights);
+        s = idf_times(fv, norm, &tf);
+    } else {
+        if (strcasecmp(e, "cnt"))
+            warning("Unknown embedding mode '%s', using 'cnt.", e);
+        s = norm_sum(fv->val, fv->len, norm);
+    }
+
+    if (norm == NORM_L2)
+        s = sqrt(s);
+
+    if (norm != NORM_NONE && s > 0)
+        scale = 1.0 / s;
+    else if (norm == NORM_NONE && tf != 0)
+        scale = 1.0 / tf;
+
+    /* Second pass: scaling, thresholding and compaction */
+    for (i = 0, j = 0; i < fv->len; i++) {
+        float v = (float) (fv->val[i] * scale);
+        int keep = fabs(v) > FVEC_ZERO;
+
+        if (tl != 0.0)
+            keep &= v >= tl;
+        if (th != 0.0)
+            keep &= v <= th;
+
+        fv->dim[j] = fv->dim[i];
+        fv->val[j] = v;
+        j += keep;
+    }
+
+    fv->len = j;
+}
+
+/**
+ * Merges document frequencies into the store. The dimensions of the
+ * frequencies need to be sorted in ascending order.
+ * @param dim Array of dimensions
+ * @param cnt Array of document frequencies
+ * @param len Length of arrays
+ * @param docs Number of documents
+ * @return 1 on success, 0 otherwise
+ */
+static int df_merge(feat_t *dim, uint64_t *cnt, uint64_t len, uint64_t docs)
+{
+    uint64_t i = 0, j = 0, k = 0;
+    feat_t *m_dim;
+    uint64_t *m_cnt;
+
+    m_dim = malloc((df_len + len) * sizeof(feat_t) + 1);
+    m_cnt = malloc((df_len + len) * sizeof(uint64_t) + 1);
+    if (!m_dim || !m_cnt) {
+        error("Could not allocate document frequencies");
+        free(m_dim);
+        free(m_cnt);
+        return FALSE;
+    }
+
+    while (i < df_len && j < len) {
+        if (df_dim[i] < dim[j]) {
+            m_dim[k] = df_dim[i];
+            m_cnt[k++] = df_cnt[i++];
+        } else if (df_dim[i] > dim[j]) {
+            m_dim[k] = dim[j];
+            m_cnt[k++] = cnt[j++];
+        } else {
+            m_dim[k] = df_dim[i];
+            m_cnt[k++] = df_cnt[i++] + cnt[j++];
+        }
+    }
+    for (; i < df_len; i++, k++) {
+        m_dim[k] = df_dim[i];
+        m_cnt[k] = df_cnt[i];
+    }
+    for (; j < len; j++, k++) {
+        m_dim[k] = dim[j];
+        m_cnt[k] = cnt[j];
+    }
+
+    free(df_dim);
+    free(df_cnt);
+    df_dim = m_dim;
+    df_cnt = m_cnt;
+    df_len = k;
+    df_docs += docs;
+
+    return TRUE;
+}
+
+/**
+ * Flushes the document frequencies of the current run to the store.
+ * The counts of a run are kept as floats and thus need to be moved to
+ * the store before exceeding the precision of a float.
+ */
+static void df_flush()
+{
+    uint64_t i, *cnt;
+
+    if (!df_run)
+        return;
+
+    cnt = malloc(df_run->len * sizeof(uint64_t) + 1);
+    if (!cnt) {
+        error("Could not allocate document frequencies");
+        return;
+    }
+
+    for (i = 0; i < df_run->len; i++)
+        cnt[i] = (uint64_t) llroundf(df_run->val[i]);
+
+    df_merge(df_run->dim, cnt, df_run->len, df_run_docs);
+    free(cnt);
+
+    fvec_destroy(df_run);
+    df_run = NULL;
+    df_run_docs = 0;
+}
+
+/**
+ * Counts the features of a string for the document frequencies.
+ * @param fv Binarized feature vector of the string
+ */
+static void df_count(fvec_t *fv)
+{
+    if (!df_run)
+        df_run = fvec_zero();
+
+    fvec_add(df_run, fv);
+    if (++df_run_docs >= DF_RUN_DOCS)
+        df_flush();
+}
+
+/**
+ * Loads a store of document frequencies and merges it with the
+ * current store. Hence, stores of different runs can be summed.
+ * @param file File name
+ * @return 1 on success, 0 if the file is not a store, -1 on error
+ */
+static int df_load(const char *file)
+{
+    char magic[DF_MAGIC_LEN];
+    uint64_t docs, len, i, *raw = NULL, *cnt = NULL;
+    feat_t *dim = NULL;
+    int ret = -1;
+
+    gzFile z = gzopen(file, "rb");
+    if (!z) {
+        error("Could not open '%s' for reading", file);
+        return -1;
+    }
+
+    if (gzread(z, magic, DF_MAGIC_LEN) != DF_MAGIC_LEN ||
+        memcmp(magic, DF_MAGIC, DF_MAGIC_LEN)) {
+        gzclose(z);
+        return 0;
+    }
+
+    if (gzread(z, &docs, sizeof(docs)) != sizeof(docs) ||
+        gzread(z, &len, sizeof(len)) != sizeof(len))
+        goto out;
+
+    raw = malloc(len * sizeof(uint64_t) + 1);
+    dim = malloc(len * sizeof(feat_t) + 1);
+    cnt = malloc(len * sizeof(uint64_t) + 1);
+    if (!raw || !dim || !cnt)
+        goto out;
+
+    if (gzread(z, raw, len * sizeof(uint64_t)) != len * sizeof(uint64_t) ||
+        gzread(z, cnt, len * sizeof(uint64_t)) != len * sizeof(uint64_t))
+        goto out;
+
+    /* Dimensions are always stored with 64 bits */
+    for (i = 0; i < len; i++) {
+        if (raw[i] > FEAT_MAX)
+            goto out;
+        dim[i] = (feat_t) raw[i];
+    }
+
+    if (df_merge(dim, cnt, len, docs))
+        ret = 1;
+
+  out:
+    if (ret < 0)
+        error("Could not read document frequencies from '%s'", file);
+
+    free(raw);
+    free(dim);
+    free(cnt);
+    gzclose(z);
+    return ret;
+}
+
+/**
+ * Saves the store of document frequencies to a file.
+ * @param file File name
+ */
+static void df_save(const char *file)
+{
+    uint64_t i, *raw;
+
+    /* Dimensions are always stored with 64 bits */
+    raw = malloc(df_len * sizeof(uint64_t) + 1);
+    if (!raw) {
+        error("Could not allocate document frequencies");
+        return;
+    }
+    for (i = 0; i < df_len; i++)
+        raw[i] = df_dim[i];
+
+    gzFile z = gzopen(file, "wb9");
+    if (!z) {
+        error("Could not open '%s' for writing", file);
+        free(raw);
+        return;
+    }
+
+    if (gzwrite(z, DF_MAGIC, DF_MAGIC_LEN) != DF_MAGIC_LEN ||
+        gzwrite(z, &df_docs, sizeof(df_docs)) != sizeof(df_docs) ||
+        gzwrite(z, &df_len, sizeof(df_len)) != sizeof(df_len) ||
+        gzwrite(z, raw, df_len * sizeof(uint64_t)) !=
+        df_len * sizeof(uint64_t) ||
+        gzwrite(z, df_cnt, df_len * sizeof(uint64_t)) !=
+        df_len * sizeof(uint64_t))
+        error("Could not write document frequencies to '%s'", file);
+
+    gzclose(z);
+    free(raw);
+}
+
+/**
+ * Destroys the store of document frequencies.
+ */
+static void df_destroy()
+{
+    if (df_run)
+        fvec_destroy(df_run);
+    free(df_dim);
+    free(df_cnt);
+
+    df_run = NULL;
+    df_run_docs = 0;
+    df_dim = NULL;
+    df_cnt = NULL;
+    df_len = df_docs = 0;
+}
+
+/**
+ * Computes the IDF weights from the store of document frequencies.
+ * The computation is linear in the size of the vocabulary.
+ */
+static void df_weights()
+{
+    uint64_t i;
+
+    idf_weights = fvec_zero();
+    if (!fvec_reserve(idf_weights, df_len))
+        return;
+
+    for (i = 0; i < df_len; i++) {
+        idf_weights->dim[i] = df_dim[i];
+        idf_weights->val[i] = (float) df_cnt[i];
+    }
+    idf_weights->len = df_len;
+
+    fvec_invert(idf_weights);
+    fvec_mul(idf_weights, df_docs);
+    fvec_log2(idf_weights);
+}
+
+/**
+ * Checks whether the input needs to be counted for the IDF weights.
+ * This is the case if the store is updated or if no store is
+ * available at all.
+ * @return 1 if the input is counted, 0 otherwise
+ */
+int idf_count_input()
+{
+    int update;
+    const char *tfidf_file, *merge;
+
+    config_lookup_bool(&cfg, "features.tfidf_update", &update);
+    config_lookup_string(&cfg, "features.tfidf_file", &tfidf_file);
+    config_lookup_string(&cfg, "features.tfidf_merge", &merge);
+
+    if (update)
+        return TRUE;
+
+    return access(tfidf_file, R_OK) && strlen(merge) == 0;
+}
+
+/**
+ * Counts the features of the sliding windows over a string for the
+ * document frequencies.
+ * @param s String
+ */
+static void idf_count_windows(string_t *s)
+{
+    long k, num;
+    fvec_t **x = fwindow_extract(s->str, s->len, &num);
+
+    for (k = 0; k < num; k++) {
+        fvec_binarize(x[k]);
+        df_count(x[k]);
+        fvec_destroy(x[k]);
+    }
+    free(x);
+}
+
 /**
  * Compute IDF weighting
  * @param input Input source 
@@ -72,16 +576,13 @@ void idf_create(char *input)
     long read, entries, i, j;
     cfg_int chunk;
     const char *in_format;
-    const char *tfidf_file;
 
     config_lookup_string(&cfg, "input.input_format", &in_format);
     config_lookup_int(&cfg, "input.chunk_size", &chunk);
-    config_lookup_string(&cfg, "features.tfidf_file", &tfidf_file);
 
-    /* Load old file if present */
-    if (!access(tfidf_file, R_OK)) {
-        info_msg(1, "Loading IDF weights from '%s'.", tfidf_file);
-        idf_weights = fvec_load((char *) tfidf_file);
+    /* Use stored document frequencies only */
+    if (!idf_count_input()) {
+        idf_finish(0);
         return;
     }
 
@@ -92,8 +593,6 @@ void idf_create(char *input)
         return;
     }
 
-    idf_weights = fvec_zero();
-
     /* Open input */
     input_config(in_format);
     entries = input_open(input);
@@ -121,9 +620,15 @@ void idf_create(char *input)
             continue;
 
         for (j = 0; j < read; j++) {
+            /* Sliding windows are counted as documents */
+            if (fwindow_enabled()) {
+                idf_count_windows(&strs[j]);
+                continue;
+            }
+
             fvec_t *x = fvec_extract_intern(strs[j].str, strs[j].len);
             fvec_binarize(x);
-            fvec_add(idf_weights, x);
+            df_count(x);
             fvec_destroy(x);
         }
 
@@ -136,13 +641,184 @@ void idf_create(char *input)
     input_close();
     free(strs);
 
-    /* Finish computation */
-    fvec_invert(idf_weights);
-    fvec_mul(idf_weights, entries);
-    fvec_log2(idf_weights);
+    idf_finish(entries);
+}
 
-    info_msg(1, "Saving IDF weights to '%s'.", tfidf_file);
-    fvec_save(idf_weights, (char *) tfidf_file);
+/**
+ * Finishes the computation of IDF weights. The counted document
+ * frequencies are merged with the configured store and the stores to
+ * merge. The store is saved and the weights are computed from it. A
+ * damaged store or a file to merge that is not a store stops the run
+ * before anything is saved.
+ * @param entries Number of counted strings
+ */
+static void idf_finish(long entries)
+{
+    const char *tfidf_file, *merge;
+    char *list, *file, *tok;
+    int ret, dirty = entries > 0;
+
+    config_lookup_string(&cfg, "features.tfidf_file", &tfidf_file);
+    config_lookup_string(&cfg, "features.tfidf_merge", &merge);
+
+    /* Load existing store or plain weights */
+    if (!access(tfidf_file, R_OK)) {
+        ret = df_load(tfidf_file);
+
+        /* A damaged store must not be overwritten or used */
+        if (ret < 0)
+            fatal("Document frequencies in '%s' are damaged.", tfidf_file);
+        if (ret == 0) {
+            if (dirty || strlen(merge) > 0)
+                warning("File '%s' contains no document frequencies. "
+                        "Ignoring input.", tfidf_file);
+            info_msg(1, "Loading IDF weights from '%s'.", tfidf_file);
+            df_destroy();
+            idf_weights = fvec_load((char *) tfidf_file);
+            if (!idf_weights)
+                fatal("Could not load IDF weights from '%s'.", tfidf_file);
+            idf_table_create();
+            return;
+        }
+        if (ret > 0)
+            info_msg(1, "Loaded document frequencies of %lu strings "
+                     "from '%s'.", (unsigned long) df_docs, tfidf_file);
+    }
+
+    /* Merge further stores */
+    list = strdup(merge);
+    for (file = strtok_r(list, ":", &tok); file;
+         file = strtok_r(NULL, ":", &tok)) {
+        info_msg(1, "Merging document frequencies from '%s'.", file);
+        ret = df_load(file);
+        if (ret < 0)
+            fatal("Document frequencies in '%s' are damaged.", file);
+        /* Plain weights cannot be merged */
+        if (ret == 0)
+            fatal("File '%s' contains no document frequencies.", file);
+        dirty = TRUE;
+    }
+    free(list);
+
+    /* Merge counted strings */
+    df_flush();
+
+    if (dirty) {
+        info_msg(1, "Saving document frequencies to '%s'.", tfidf_file);
+        df_save(tfidf_file);
+    }
+
+    df_weights();
+    df_destroy();
+    idf_table_create();
+}
+
+/**
+ * Opens a temporary spill file for single-pass TFIDF weighting. The
+ * raw feature vectors are written to this file, while the document
+ * frequencies are accumulated. The file is unlinked immediately and
+ * thus removed automatically once it is closed.
+ * @return 1 on success, 0 otherwise
+ */
+int idf_spill_open()
+{
+    char path[MAX_PATH_LEN];
+    const char *tmp = getenv("TMPDIR");
+
+    snprintf(path, MAX_PATH_LEN, "%s/sally-XXXXXX", tmp ? tmp : "/tmp");
+    spill_fd = mkstemp(path);
+    if (spill_fd == -1) {
+        error("Could not create spill file '%s'", path);
+        return FALSE;
+    }
+    unlink(path);
+
+    spill_z = gzdopen(dup(spill_fd), "wb1");
+    if (!spill_z) {
+        error("Could not open spill file for writing");
+        close(spill_fd);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Writes a block of raw feature vectors to the spill file and adds
+ * them to the document frequencies.
+ * @param x Feature vectors (not post-processed)
+ * @param len Number of vectors
+ * @return 1 on success, 0 otherwise
+ */
+int idf_spill_write(fvec_t **x, int len)
+{
+    int j;
+
+    for (j = 0; j < len; j++) {
+        if (!fvec_write_bin(x[j], spill_z)) {
+            error("Could not write to spill file");
+            return FALSE;
+        }
+
+        fvec_t *b = fvec_clone(x[j]);
+        fvec_binarize(b);
+        df_count(b);
+        fvec_destroy(b);
+    }
+
+    return TRUE;
+}
+
+/**
+ * Finishes the IDF weights and rewinds the spill file for reading.
+ * @param entries Number of spilled strings
+ * @return 1 on success, 0 otherwise
+ */
+int idf_spill_rewind(long entries)
+{
+    gzclose(spill_z);
+    info_msg(1, "Computing IDF weights from %ld spilled strings.", entries);
+    idf_finish(entries);
+
+    lseek(spill_fd, 0, SEEK_SET);
+    spill_z = gzdopen(spill_fd, "rb");
+    if (!spill_z) {
+        error("Could not open spill file for reading");
+        close(spill_fd);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Reads a block of raw feature vectors from the spill file.
+ * @param x Array for feature vectors
+ * @param len Length of array
+ * @return number of read vectors
+ */
+int idf_spill_read(fvec_t **x, int len)
+{
+    int j;
+
+    for (j = 0; j < len; j++) {
+        x[j] = fvec_read_bin(spill_z);
+        if (!x[j])
+            break;
+    }
+
+    return j;
+}
+
+/**
+ * Closes the spill file. The file is removed automatically.
+ */
+void idf_spill_close()
+{
+    if (spill_z)
+        gzclose(spill_z);
+    spill_z = NULL;
+    spill_fd = -1;
 }
 
 /**
@@ -151,6 +827,9 @@ void idf_create(char *input)
 void idf_destroy()
 {
     fvec_destroy(idf_weights);
+    free(idf_table);
+    idf_weights = NULL;
+    idf_table = NULL;
 }
 
 /**
@@ -15,9 +15,27 @@
 
 #include "fvec.h"
 
+/** Maximum hash bits for a table of IDF weights (256 MB) */
+#define IDF_TABLE_BITS  26
+
+/** Magic bytes of a store of document frequencies */
+#define DF_MAGIC        "sally-df"
+#define DF_MAGIC_LEN    8
+/** Maximum number of strings counted before flushing to the store */
+#define DF_RUN_DOCS     (1 << 20)
+
 void fvec_embed(fvec_t *fv, const char *);
+void fvec_embed_norm(fvec_t *fv, const char *, const char *, double, double);
 void idf_create(char *input);
 void idf_destroy();
+int idf_count_input();
 int idf_check(fvec_t *f);
 
+/* Single-pass TFIDF weighting */
+int idf_spill_open();
+int idf_spill_write(fvec_t **x, int len);
+int idf_spill_rewind(long entries);
+int idf_spill_read(fvec_t **x, int len);
+void idf_spill_close();
+
 #endif /* EMBED */
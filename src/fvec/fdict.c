@@ -0,0 +1,483 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+/**
+ * @addtogroup fvec Feature vector
+ * <hr>
+ * Dictionary of features. Instead of hashing, every feature is interned
+ * and mapped to a consecutive id, such that the dimensions are free of
+ * collisions and the string of each dimension is available. The strings
+ * are stored in an arena of fixed blocks that are never moved. The
+ * index is split into shards, which are locked independently during
+ * parallel extraction. A dictionary is saved in a flat format with an
+ * open addressing table that is mapped into memory and used read-only
+ * in later runs.
+ * @author Konrad Rieck (konrad@mlsec.org)
+ * @{
+ */
+
+#include "config.h"
+#include "common.h"
+#include "fvec.h"
+#include "fdict.h"
+#include "util.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+/** Size of header of arena entries: hash and length */
+#define ENTRY_HDR       (sizeof(uint64_t) + sizeof(uint32_t))
+/** Size of header of dictionary files */
+#define FILE_HDR        (FDICT_MAGIC_LEN + 3 * sizeof(uint64_t))
+
+/**
+ * Shard of the index of the dictionary
+ */
+typedef struct
+{
+    feat_t *id;             /**< Ids + 1 of entries (0 = empty) */
+    uint64_t *hash;         /**< Hashes of entries */
+    unsigned long size;     /**< Size of table (power of two) */
+    unsigned long len;      /**< Number of entries */
+#ifdef HAVE_OPENMP
+    omp_lock_t lock;        /**< Lock of shard */
+#endif
+} fdict_shard_t;
+
+/* Dictionary */
+static int enabled = FALSE;
+static int mapped = FALSE;
+static char *dict_file = NULL;
+
+/* Index, arena and table of ids */
+static fdict_shard_t shards[FDICT_SHARDS];
+static char **pages[FDICT_PAGES];
+static char **blocks = NULL;
+static unsigned long blocks_len = 0;
+static size_t block_used = 0, block_size = 0;
+static uint64_t num = 0;
+
+/* Mapped dictionary */
+static uint8_t *map = NULL;
+static size_t map_len = 0;
+static uint64_t *map_off = NULL, *map_table = NULL;
+static uint64_t map_num = 0, map_tsize = 0;
+static char *map_data = NULL;
+
+/**
+ * Returns the arena entry of an id
+ * @param id Id of feature
+ * @return entry
+ */
+static inline char *entry_get(uint64_t id)
+{
+    return pages[id >> FDICT_PAGE_BITS][id & (FDICT_PAGE - 1)];
+}
+
+/**
+ * Checks whether an arena entry contains a string
+ * @param e Entry
+ * @param s String
+ * @param l Length of string
+ * @return 1 if equal, 0 otherwise
+ */
+static inline int entry_equals(char *e, char *s, int l)
+{
+    uint32_t len;
+    memcpy(&len, e + sizeof(uint64_t), sizeof(uint32_t));
+    return len == (uint32_t) l && !memcmp(e + ENTRY_HDR, s, l);
+}
+
+/**
+ * Appends a string to the arena and assigns the next id. The function
+ * needs to be called in a critical section.
+ * @param s String
+ * @param l Length of string
+ * @param h Hash of string
+ * @return id of string
+ */
+static uint64_t arena_append(char *s, int l, uint64_t h)
+{
+    size_t need = ENTRY_HDR + l;
+    uint32_t len = l;
+    uint64_t id = num;
+    char *e;
+    void *p;
+
+    if (id >= (uint64_t) FDICT_PAGES << FDICT_PAGE_BITS || id >= FDICT_NONE)
+        fatal("Dictionary of features is full");
+
+    /* Start new block */
+    if (block_used + need > block_size) {
+        block_size = need > FDICT_BLOCK ? need : FDICT_BLOCK;
+        p = realloc(blocks, (blocks_len + 1) * sizeof(char *));
+        if (!p || !(((char **) p)[blocks_len] = malloc(block_size)))
+            fatal("Could not allocate dictionary of features");
+        blocks = p;
+        blocks_len++;
+        block_used = 0;
+    }
+
+    e = blocks[blocks_len - 1] + block_used;
+    block_used += need;
+    memcpy(e, &h, sizeof(uint64_t));
+    memcpy(e + sizeof(uint64_t), &len, sizeof(uint32_t));
+    memcpy(e + ENTRY_HDR, s, l);
+
+    if (!pages[id >> FDICT_PAGE_BITS]) {
+        pages[id >> FDICT_PAGE_BITS] = malloc(FDICT_PAGE * sizeof(char *));
+        if (!pages[id >> FDICT_PAGE_BITS])
+            fatal("Could not allocate dictionary of features");
+    }
+    pages[id >> FDICT_PAGE_BITS][id & (FDICT_PAGE - 1)] = e;
+    num++;
+
+    return id;
+}
+
+/**
+ * Doubles the size of a shard
+ * @param sh Shard
+ */
+static void shard_grow(fdict_shard_t *sh)
+{
+    unsigned long i, j, size = sh->size ? 2 * sh->size : 1024;
+    feat_t *id = calloc(size, sizeof(feat_t));
+    uint64_t *hash = malloc(size * sizeof(uint64_t));
+
+    if (!id || !hash)
+        fatal("Could not allocate dictionary of features");
+
+    for (i = 0; i < sh->size; i++) {
+        if (!sh->id[i])
+            continue;
+        for (j = sh->hash[i] & (size - 1); id[j]; j = (j + 1) & (size - 1));
+        id[j] = sh->id[i];
+        hash[j] = sh->hash[i];
+    }
+
+    free(sh->id);
+    free(sh->hash);
+    sh->id = id;
+    sh->hash = hash;
+    sh->size = size;
+}
+
+/**
+ * Looks up a string in the mapped dictionary
+ * @param s String
+ * @param l Length of string
+ * @param h Hash of string
+ * @return id of string or FDICT_NONE
+ */
+static feat_t map_find(char *s, int l, uint64_t h)
+{
+    uint64_t i, x, id;
+
+    for (i = h & (map_tsize - 1); (x = map_table[i]);
+         i = (i + 1) & (map_tsize - 1)) {
+        id = x - 1;
+        if (map_off[id + 1] - map_off[id] == (uint64_t) l &&
+            !memcmp(map_data + map_off[id], s, l))
+            return (feat_t) id;
+    }
+
+    return FDICT_NONE;
+}
+
+/**
+ * Returns the id of a feature. If the dictionary has been loaded from a
+ * file, unknown features are not added and FDICT_NONE is returned.
+ * Otherwise unknown features are interned with the next id.
+ * @param s String of feature
+ * @param l Length of string
+ * @param h Hash of string
+ * @return id of feature
+ */
+feat_t fdict_id(char *s, int l, uint64_t h)
+{
+    fdict_shard_t *sh;
+    unsigned long i;
+    uint64_t id;
+
+    if (mapped)
+        return map_find(s, l, h);
+
+    sh = shards + ((h * 0x9e3779b97f4a7c15ULL) >> 32) % FDICT_SHARDS;
+#ifdef HAVE_OPENMP
+    omp_set_lock(&sh->lock);
+#endif
+
+    if (2 * (sh->len + 1) > sh->size)
+        shard_grow(sh);
+
+    for (i = h & (sh->size - 1); sh->id[i]; i = (i + 1) & (sh->size - 1)) {
+        if (sh->hash[i] != h || !entry_equals(entry_get(sh->id[i] - 1), s, l))
+            continue;
+        id = sh->id[i] - 1;
+        goto out;
+    }
+
+#ifdef HAVE_OPENMP
+#pragma omp critical (fdict)
+#endif
+    id = arena_append(s, l, h);
+
+    sh->id[i] = (feat_t) (id + 1);
+    sh->hash[i] = h;
+    sh->len++;
+
+  out:
+#ifdef HAVE_OPENMP
+    omp_unset_lock(&sh->lock);
+#endif
+    return (feat_t) id;
+}
+
+/**
+ * Returns the string of a feature
+ * @warning The returned memory must not be freed.
+ * @param id Id of feature
+ * @param l Length of string
+ * @return string or NULL if the id is unknown
+ */
+char *fdict_get(feat_t id, int *l)
+{
+    uint32_t len;
+    char *e;
+
+    if (mapped) {
+        if (id >= map_num)
+            return NULL;
+        *l = (int) (map_off[id + 1] - map_off[id]);
+        return map_data + map_off[id];
+    }
+
+    if (id >= num)
+        return NULL;
+
+    e = entry_get(id);
+    memcpy(&len, e + sizeof(uint64_t), sizeof(uint32_t));
+    *l = (int) len;
+    return e + ENTRY_HDR;
+}
+
+/**
+ * Saves the dictionary in the flat format. The file contains the header,
+ * the offsets of the strings, the open addressing table of ids + 1 and
+ * the concatenated strings.
+ * @param file File name
+ */
+static void dict_save(const char *file)
+{
+    uint64_t i, j, h, tsize = 16, bytes = 0, *off, *table;
+    uint32_t len;
+    FILE *f;
+    char *e;
+    int r = 0;
+
+    while (tsize < 2 * num)
+        tsize <<= 1;
+
+    off = malloc((num + 1) * sizeof(uint64_t));
+    table = calloc(tsize, sizeof(uint64_t));
+    if (!off || !table) {
+        error("Could not allocate dictionary of features");
+        goto out;
+    }
+
+    for (i = 0; i < num; i++) {
+        e = entry_get(i);
+        memcpy(&h, e, sizeof(uint64_t));
+        memcpy(&len, e + sizeof(uint64_t), sizeof(uint32_t));
+        for (j = h & (tsize - 1); table[j]; j = (j + 1) & (tsize - 1));
+        table[j] = i + 1;
+        off[i] = bytes;
+        bytes += len;
+    }
+    off[num] = bytes;
+
+    f = fopen(file, "w");
+    if (!f) {
+        error("Could not open '%s' for writing", file);
+        goto out;
+    }
+
+    r += fwrite(FDICT_MAGIC, FDICT_MAGIC_LEN, 1, f);
+    r += fwrite(&num, sizeof(uint64_t), 1, f);
+    r += fwrite(&tsize, sizeof(uint64_t), 1, f);
+    r += fwrite(&bytes, sizeof(uint64_t), 1, f);
+    r += fwrite(off, sizeof(uint64_t), num + 1, f) == num + 1;
+    r += fwrite(table, sizeof(uint64_t), tsize, f) == tsize;
+    for (i = 0; i < num; i++) {
+        e = entry_get(i);
+        r += fwrite(e + ENTRY_HDR, 1, off[i + 1] - off[i], f) ==
+            off[i + 1] - off[i];
+    }
+    if (r != 6 + num)
+        error("Could not write dictionary to '%s'", file);
+
+    fclose(f);
+  out:
+    free(off);
+    free(table);
+}
+
+/**
+ * Maps a dictionary file into memory.
+ * @param file File name
+ * @return 1 on success, 0 otherwise
+ */
+static int dict_load(const char *file)
+{
+    struct stat st;
+    uint64_t hdr[3];
+    int fd;
+
+    fd = open(file, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        error("Could not open dictionary '%s'", file);
+        if (fd != -1)
+            close(fd);
+        return FALSE;
+    }
+
+    map_len = st.st_size;
+    map = map_len >= FILE_HDR ?
+        mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        error("Could not map dictionary '%s'", file);
+        return FALSE;
+    }
+
+    memcpy(hdr, map + FDICT_MAGIC_LEN, sizeof(hdr));
+    map_num = hdr[0], map_tsize = hdr[1];
+    if (memcmp(map, FDICT_MAGIC, FDICT_MAGIC_LEN) || !map_tsize ||
+        (map_tsize & (map_tsize - 1)) || map_tsize <= map_num ||
+        map_len != FILE_HDR + (map_num + 1 + map_tsize) * sizeof(uint64_t)
+        + hdr[2]) {
+        error("Invalid dictionary '%s'", file);
+        munmap(map, map_len);
+        map = NULL;
+        return FALSE;
+    }
+
+    map_off = (uint64_t *) (map + FILE_HDR);
+    map_table = map_off + map_num + 1;
+    map_data = (char *) (map_table + map_tsize);
+
+    return TRUE;
+}
+
+/**
+ * Enables the dictionary of features. If the file exists, it is mapped
+ * into memory and used read-only. Otherwise the dictionary is built
+ * during extraction and saved to the file by fdict_destroy().
+ * @param file File name
+ */
+void fdict_init(const char *file)
+{
+    int i;
+
+    if (enabled)
+        fdict_destroy();
+
+    if (!access(file, R_OK)) {
+        info_msg(1, "Mapping dictionary of features from '%s'.", file);
+        if (!dict_load(file))
+            fatal("Could not load dictionary of features");
+        mapped = TRUE;
+    } else {
+        dict_file = strdup(file);
+        memset(shards, 0, sizeof(shards));
+        for (i = 0; i < FDICT_SHARDS; i++) {
+#ifdef HAVE_OPENMP
+            omp_init_lock(&shards[i].lock);
+#endif
+            shard_grow(shards + i);
+        }
+        mapped = FALSE;
+    }
+
+    enabled = TRUE;
+}
+
+/**
+ * Destroys the dictionary of features. A dictionary built during the
+ * extraction is saved to its file before.
+ */
+void fdict_destroy()
+{
+    unsigned long i;
+
+    if (!enabled)
+        return;
+
+    if (mapped) {
+        munmap(map, map_len);
+        map = NULL;
+        map_num = map_tsize = 0;
+        enabled = mapped = FALSE;
+        return;
+    }
+
+    info_msg(1, "Saving dictionary of %lu features to '%s'.",
+             (unsigned long) num, dict_file);
+    dict_save(dict_file);
+
+    for (i = 0; i < FDICT_SHARDS; i++) {
+        free(shards[i].id);
+        free(shards[i].hash);
+#ifdef HAVE_OPENMP
+        omp_destroy_lock(&shards[i].lock);
+#endif
+    }
+    for (i = 0; i < FDICT_PAGES && pages[i]; i++) {
+        free(pages[i]);
+        pages[i] = NULL;
+    }
+    for (i = 0; i < blocks_len; i++)
+        free(blocks[i]);
+    free(blocks);
+    free(dict_file);
+
+    blocks = NULL;
+    dict_file = NULL;
+    blocks_len = block_used = block_size = 0;
+    num = 0;
+    enabled = FALSE;
+}
+
+/**
+ * Checks whether the dictionary of features is enabled
+ * @return 1 if enabled, 0 otherwise
+ */
+int fdict_enabled()
+{
+    return enabled;
+}
+
+/**
+ * Returns the number of features in the dictionary
+ * @return number of features
+ */
+unsigned long fdict_size()
+{
+    return mapped ? map_num : num;
+}
+
+/** @} */
@@ -0,0 +1,39 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+#ifndef FDICT_H
+#define FDICT_H
+
+#include "fvec.h"
+
+/** Magic bytes of a dictionary file */
+#define FDICT_MAGIC         "sally-dt"
+#define FDICT_MAGIC_LEN     8
+/** Number of independently locked shards of the dictionary */
+#define FDICT_SHARDS        64
+/** Size of the blocks of the string arena */
+#define FDICT_BLOCK         (1 << 20)
+/** Number of ids per page of the id table */
+#define FDICT_PAGE_BITS     16
+#define FDICT_PAGE          (1 << FDICT_PAGE_BITS)
+/** Maximum number of pages of the id table */
+#define FDICT_PAGES         (1 << 16)
+/** Id of features not contained in a read-only dictionary */
+#define FDICT_NONE          FEAT_MAX
+
+void fdict_init(const char *file);
+void fdict_destroy();
+int fdict_enabled();
+feat_t fdict_id(char *s, int l, uint64_t h);
+char *fdict_get(feat_t id, int *l);
+unsigned long fdict_size();
+
+#endif /* FDICT_H */
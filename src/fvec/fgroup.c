@@ -0,0 +1,254 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+/**
+ * @addtogroup fvec Feature vector
+ * <hr>
+ * Aggregation of feature vectors by group. A key is extracted from each
+ * string or its source using a regular expression and the vectors with
+ * the same key are summed. The key replaces the source of the vector.
+ * Each thread sums into its own map of groups, such that no locking is
+ * needed during the processing. The maps are merged when the groups
+ * are flushed.
+ * @author Konrad Rieck (konrad@mlsec.org)
+ * @{
+ */
+
+#include "config.h"
+#include "common.h"
+#include "fvec.h"
+#include "fhash.h"
+#include "fmath.h"
+#include "fgroup.h"
+#include "util.h"
+
+#include <regex.h>
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * Group of feature vectors
+ */
+typedef struct
+{
+    fvec_t *fv;             /**< Sum of vectors (source is key) */
+    UT_hash_handle hh;      /**< Uthash handle */
+} fgroup_t;
+
+/* External variables */
+extern config_t cfg;
+
+/* Groups */
+static int enabled = FALSE;
+static int use_src = FALSE;
+static regex_t re;
+static fgroup_t **maps = NULL;
+static int maps_len = 0;
+
+/**
+ * Enables the aggregation of vectors
+ * @param pattern Regular expression for keys
+ */
+void fgroup_init(const char *pattern)
+{
+    config_lookup_bool(&cfg, "filter.group_source", &use_src);
+
+    if (regcomp(&re, pattern, REG_EXTENDED) != 0)
+        fatal("Could not compile regex for group key");
+
+#ifdef HAVE_OPENMP
+    maps_len = omp_get_max_threads();
+#else
+    maps_len = 1;
+#endif
+
+    maps = calloc(maps_len, sizeof(fgroup_t *));
+    if (!maps)
+        fatal("Could not allocate maps of groups");
+
+    enabled = TRUE;
+}
+
+/**
+ * Extracts the key of a string. If the regular expression contains a
+ * subexpression, its match is used as key and otherwise the complete
+ * match. Strings without a match have an empty key.
+ * @param str String
+ * @param len Length of string
+ * @param src Source of string
+ * @return key (allocated)
+ */
+char *fgroup_key(char *str, int len, char *src)
+{
+    regmatch_t pm[2];
+    char *s, *key;
+    int i;
+
+    s = use_src ? strdup(src ? src : "") : malloc(len + 1);
+    if (!s)
+        return strdup("");
+
+    if (!use_src) {
+        memcpy(s, str, len);
+        s[len] = 0;
+    }
+
+    if (regexec(&re, s, 2, pm, 0)) {
+        free(s);
+        return strdup("");
+    }
+
+    i = pm[1].rm_so != -1 ? 1 : 0;
+    key = malloc(pm[i].rm_eo - pm[i].rm_so + 1);
+    if (key) {
+        memcpy(key, s + pm[i].rm_so, pm[i].rm_eo - pm[i].rm_so);
+        key[pm[i].rm_eo - pm[i].rm_so] = 0;
+    }
+
+    free(s);
+    return key;
+}
+
+/**
+ * Adds a feature vector to its group. The source of the vector is used
+ * as key. The label of a group is the maximum label of its vectors.
+ * @param fv Feature vector
+ */
+void fgroup_add(fvec_t *fv)
+{
+    fgroup_t *g, **map;
+    char *key = fv->src ? fv->src : "";
+
+#ifdef HAVE_OPENMP
+    map = maps + omp_get_thread_num();
+#else
+    map = maps;
+#endif
+
+    HASH_FIND(hh, *map, key, strlen(key), g);
+    if (g) {
+        fvec_add(g->fv, fv);
+        if (fv->label > g->fv->label)
+            g->fv->label = fv->label;
+        return;
+    }
+
+    g = malloc(sizeof(fgroup_t));
+    if (!g || !(g->fv = fvec_clone(fv))) {
+        error("Could not allocate group");
+        free(g);
+        return;
+    }
+    if (!g->fv->src)
+        fvec_set_source(g->fv, "");
+    g->fv->label = fv->label;
+
+    HASH_ADD_KEYPTR(hh, *map, g->fv->src, strlen(g->fv->src), g);
+}
+
+/**
+ * Compares two groups by key (for qsort)
+ * @param x Group
+ * @param y Group
+ * @return comparison
+ */
+static int cmp_key(const void *x, const void *y)
+{
+    return strcmp((*(fvec_t **) x)->src, (*(fvec_t **) y)->src);
+}
+
+/**
+ * Merges the maps of all threads and returns the aggregated vectors
+ * sorted by key. The groups are removed afterwards.
+ * @param num Number of returned vectors
+ * @return array of vectors (to be freed by the caller)
+ */
+fvec_t **fgroup_flush(long *num)
+{
+    fgroup_t *g, *h;
+    fvec_t **x;
+    long i;
+    int t;
+
+    /* Merge maps of threads into the first one */
+    for (t = 1; t < maps_len; t++) {
+        while (maps[t]) {
+            g = maps[t];
+            HASH_DEL(maps[t], g);
+            HASH_FIND(hh, maps[0], g->fv->src, strlen(g->fv->src), h);
+            if (!h) {
+                HASH_ADD_KEYPTR(hh, maps[0], g->fv->src,
+                                strlen(g->fv->src), g);
+                continue;
+            }
+            fvec_add(h->fv, g->fv);
+            if (g->fv->label > h->fv->label)
+                h->fv->label = g->fv->label;
+            fvec_destroy(g->fv);
+            free(g);
+        }
+    }
+
+    *num = HASH_COUNT(maps[0]);
+    x = malloc(*num * sizeof(fvec_t *) + 1);
+    if (!x)
+        fatal("Could not allocate aggregated vectors");
+
+    for (i = 0; maps[0]; i++) {
+        g = maps[0];
+        HASH_DEL(maps[0], g);
+        x[i] = g->fv;
+        free(g);
+    }
+
+    qsort(x, *num, sizeof(fvec_t *), cmp_key);
+    return x;
+}
+
+/**
+ * Destroys all groups
+ */
+void fgroup_destroy()
+{
+    fgroup_t *g;
+    int t;
+
+    if (!enabled)
+        return;
+
+    for (t = 0; t < maps_len; t++) {
+        while (maps[t]) {
+            g = maps[t];
+            HASH_DEL(maps[t], g);
+            fvec_destroy(g->fv);
+            free(g);
+        }
+    }
+
+    free(maps);
+    regfree(&re);
+    maps = NULL;
+    maps_len = 0;
+    enabled = FALSE;
+}
+
+/**
+ * Checks whether vectors are aggregated
+ * @return 1 if enabled, 0 otherwise
+ */
+int fgroup_enabled()
+{
+    return enabled;
+}
+
+/** @} */
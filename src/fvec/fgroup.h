@@ -0,0 +1,24 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+#ifndef FGROUP_H
+#define FGROUP_H
+
+#include "fvec.h"
+
+void fgroup_init(const char *pattern);
+void fgroup_destroy();
+int fgroup_enabled();
+char *fgroup_key(char *str, int len, char *src);
+void fgroup_add(fvec_t *fv);
+fvec_t **fgroup_flush(long *num);
+
+#endif /* FGROUP_H */
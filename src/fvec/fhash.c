@@ -181,7 +181,7 @@ void fhash_read(gzFile z)
     int i, r;
     unsigned long len;
     char buf[512], str[512];
-    feat_t key;
+    unsigned long long key;
 
     fhash_init();
 
@@ -194,8 +194,7 @@ void fhash_read(gzFile z)
 
     for (i = 0; i < len; i++) {
         gzgets(z, buf, 512);
-        r = sscanf(buf, "  bin=%llx:%511s\n", (unsigned long long *) &key,
-                   (char *) str);
+        r = sscanf(buf, "  bin=%llx:%511s\n", &key, (char *) str);
         if (r != 2) {
             error("Could not parse feature map contents");
             return;
@@ -205,7 +204,7 @@ void fhash_read(gzFile z)
         r = decode_str(str);
 
         /* Put string to table */
-        fhash_put(key, str, r);
+        fhash_put((feat_t) key, str, r);
     }
 }
 
@@ -0,0 +1,271 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details. 
+ */
+
+/** 
+ * @addtogroup fvec Feature vector
+ * @author Konrad Rieck (konrad@mlsec.org)
+ * @{
+ */
+
+#include "config.h"
+#include "common.h"
+#include "fvec.h"
+#include "findex.h"
+#include "fzvec.h"
+#include "util.h"
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * Entry of a vector used for sorting
+ */
+typedef struct
+{
+    feat_t dim;            /**< Dimension */
+    unsigned long pos;     /**< Position in vectors */
+} fentry_pos_t;
+
+/**
+ * Sorts entries by dimension with a stable radix sort starting at the
+ * least significant digit. In each pass, the digits of blocks of
+ * entries are counted in parallel, the offsets of the blocks are
+ * computed by a prefix sum and the blocks are scattered in parallel.
+ * As the sort is stable, entries of the same dimension keep the order
+ * of their positions. Only the digits spanned by the range of the
+ * dimensions are sorted.
+ * @param e Entries
+ * @param t Temporary entries of the same length
+ * @param n Number of entries
+ * @param min Minimum dimension
+ * @param max Maximum dimension
+ * @return sorted entries (either e or t) or NULL on error
+ */
+static fentry_pos_t *radix_sort(fentry_pos_t *e, fentry_pos_t *t,
+                                unsigned long n, feat_t min, feat_t max)
+{
+    unsigned long *cnt, c, s;
+    int shift, blocks = 1, b, d;
+    fentry_pos_t *x;
+
+#ifdef HAVE_OPENMP
+    blocks = omp_get_max_threads();
+#endif
+    cnt = malloc(blocks * FINDEX_RADIX * sizeof(unsigned long));
+    if (!cnt)
+        return NULL;
+
+    for (shift = 0; max > min && shift < FEAT_BITS && (max - min) >> shift;
+         shift += FINDEX_RADIX_BITS) {
+        memset(cnt, 0, blocks * FINDEX_RADIX * sizeof(unsigned long));
+
+        /* Count digits of blocks */
+#ifdef HAVE_OPENMP
+#pragma omp parallel for
+#endif
+        for (b = 0; b < blocks; b++) {
+            unsigned long k, *h = cnt + b * FINDEX_RADIX;
+            for (k = n * b / blocks; k < n * (b + 1) / blocks; k++)
+                h[((e[k].dim - min) >> shift) & (FINDEX_RADIX - 1)]++;
+        }
+
+        /* Offsets of blocks ordered by digit and block */
+        for (d = 0, s = 0; d < FINDEX_RADIX; d++) {
+            for (b = 0; b < blocks; b++) {
+                c = cnt[b * FINDEX_RADIX + d];
+                cnt[b * FINDEX_RADIX + d] = s;
+                s += c;
+            }
+        }
+
+        /* Scatter blocks */
+#ifdef HAVE_OPENMP
+#pragma omp parallel for
+#endif
+        for (b = 0; b < blocks; b++) {
+            unsigned long k, *h = cnt + b * FINDEX_RADIX;
+            for (k = n * b / blocks; k < n * (b + 1) / blocks; k++)
+                t[h[((e[k].dim - min) >> shift) & (FINDEX_RADIX - 1)]++] =
+                    e[k];
+        }
+
+        x = e, e = t, t = x;
+    }
+
+    free(cnt);
+    return e;
+}
+
+/**
+ * Creates an inverted index for a set of compressed vectors. The
+ * entries of vector i are located at the positions pos[i] to
+ * pos[i + 1] - 1 of the set. The entries are decoded and sorted by
+ * dimension in parallel.
+ * @param zs Set of compressed vectors
+ * @return inverted index
+ */
+findex_t *findex_create(fzset_t *zs)
+{
+    unsigned long i, k, u, num = zs->num, nnz = fzset_nnz(zs);
+    unsigned long *rows = zs->pos;
+    fentry_pos_t *e, *t, *x;
+    feat_t *dims, min = FEAT_MAX, max = 0;
+    findex_t *idx;
+    int threads = 1;
+
+#ifdef HAVE_OPENMP
+    threads = omp_get_max_threads();
+#endif
+
+    idx = calloc(1, sizeof(findex_t));
+    e = malloc(nnz * sizeof(fentry_pos_t) + 1);
+    t = malloc(nnz * sizeof(fentry_pos_t) + 1);
+    dims = malloc(threads * zs->max * sizeof(feat_t) + 1);
+    if (!idx || !e || !t || !dims) {
+        error("Could not allocate inverted index");
+        free(idx);
+        free(e);
+        free(t);
+        free(dims);
+        return NULL;
+    }
+
+    /* Decode entries and determine range of dimensions */
+#ifdef HAVE_OPENMP
+#pragma omp parallel for private(k) reduction(min:min) reduction(max:max)
+#endif
+    for (i = 0; i < num; i++) {
+#ifdef HAVE_OPENMP
+        feat_t *dim = dims + omp_get_thread_num() * zs->max;
+#else
+        feat_t *dim = dims;
+#endif
+        fzvec_t zv;
+
+        fzset_get(zs, i, &zv);
+        fzvec_decode(dim, zv.dim, zv.len);
+        for (k = 0; k < zv.len; k++) {
+            e[rows[i] + k].dim = dim[k];
+            e[rows[i] + k].pos = rows[i] + k;
+            min = dim[k] < min ? dim[k] : min;
+            max = dim[k] > max ? dim[k] : max;
+        }
+    }
+    free(dims);
+
+    /* Sort entries by dimension */
+    x = radix_sort(e, t, nnz, min, max);
+    free(x == e ? t : e);
+    if (!x) {
+        error("Could not allocate inverted index");
+        free(idx);
+        free(t);
+        return NULL;
+    }
+    e = x;
+
+    for (k = 0, u = 0; k < nnz; k++)
+        u += k == 0 || e[k].dim != e[k - 1].dim;
+
+    idx->len = u;
+    idx->nnz = nnz;
+    idx->dim = malloc(u * sizeof(feat_t) + 1);
+    idx->start = malloc((u + 1) * sizeof(unsigned long));
+    idx->max = malloc(u * sizeof(float) + 1);
+    idx->row = malloc(nnz * sizeof(unsigned long) + 1);
+    idx->val = malloc(nnz * sizeof(float) + 1);
+
+    if (!idx->dim || !idx->start || !idx->max || !idx->row || !idx->val) {
+        error("Could not allocate inverted index");
+        findex_destroy(idx);
+        free(e);
+        return NULL;
+    }
+
+    /* Postings of unique dimensions */
+    for (k = 0, u = 0; k < nnz; k++) {
+        if (k == 0 || e[k].dim != e[k - 1].dim) {
+            idx->dim[u] = e[k].dim;
+            idx->start[u++] = k;
+        }
+        idx->val[k] = zs->val[e[k].pos];
+    }
+    idx->start[u] = nnz;
+
+    /* Map positions of entries to vectors (reusing the sorted entries) */
+    for (k = 0; k < nnz; k++)
+        idx->row[k] = e[k].pos;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for private(k)
+#endif
+    for (i = 0; i < num; i++)
+        for (k = rows[i]; k < rows[i + 1]; k++)
+            e[k].pos = i;
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for private(k)
+#endif
+    for (u = 0; u < idx->len; u++) {
+        float m = 0;
+        for (k = idx->start[u]; k < idx->start[u + 1]; k++) {
+            idx->row[k] = e[idx->row[k]].pos;
+            if (fabs(idx->val[k]) > m)
+                m = fabs(idx->val[k]);
+        }
+        idx->max[u] = m;
+    }
+
+    free(e);
+    return idx;
+}
+
+/**
+ * Finds the postings of a dimension in the inverted index.
+ * @param idx Inverted index
+ * @param dim Dimension
+ * @return index of dimension or -1 if not present
+ */
+long findex_find(findex_t *idx, feat_t dim)
+{
+    unsigned long lo = 0, hi = idx->len, mid;
+
+    while (lo < hi) {
+        mid = lo + ((hi - lo) >> 1);
+        if (idx->dim[mid] < dim)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < idx->len && idx->dim[lo] == dim)
+        return (long) lo;
+    return -1;
+}
+
+/**
+ * Destroys an inverted index.
+ * @param idx Inverted index
+ */
+void findex_destroy(findex_t *idx)
+{
+    if (!idx)
+        return;
+
+    free(idx->dim);
+    free(idx->start);
+    free(idx->row);
+    free(idx->val);
+    free(idx->max);
+    free(idx);
+}
+
+/** @} */
@@ -0,0 +1,43 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details. 
+ */
+
+#ifndef FINDEX_H
+#define FINDEX_H
+
+#include "fvec.h"
+#include "fzvec.h"
+
+/** Number of bits of the digits of the radix sort */
+#define FINDEX_RADIX_BITS   8
+/** Number of buckets of the radix sort */
+#define FINDEX_RADIX        (1 << FINDEX_RADIX_BITS)
+
+/**
+ * Inverted index over the dimensions of a set of vectors. The vectors
+ * are given as a set of compressed vectors and the postings of each
+ * dimension list the vectors and values in ascending order.
+ */
+typedef struct
+{
+    feat_t *dim;           /**< Sorted unique dimensions */
+    unsigned long *start;  /**< Start of postings of dimensions */
+    unsigned long *row;    /**< Vectors of postings */
+    float *val;            /**< Values of postings */
+    float *max;            /**< Maximum value of postings of dimensions */
+    unsigned long len;     /**< Number of dimensions */
+    unsigned long nnz;     /**< Number of postings */
+} findex_t;
+
+findex_t *findex_create(fzset_t *zs);
+long findex_find(findex_t *idx, feat_t dim);
+void findex_destroy(findex_t *idx);
+
+#endif /* FINDEX_H */
@@ -0,0 +1,96 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+/**
+ * @addtogroup fvec Feature vector
+ * <hr>
+ * Bitmap of permitted features. If only a known set of features is
+ * kept, for example, the features of a vocabulary or a selection, the
+ * extraction tests every n-gram against a bitmap over the dimensions
+ * and drops it before it is stored, sorted and counted. The bitmap
+ * covers the dimensions up to the largest permitted one, that is,
+ * 512 kB for 22 hash bits.
+ * @author Konrad Rieck (konrad@mlsec.org)
+ * @{
+ */
+
+#include "config.h"
+#include "common.h"
+#include "fvec.h"
+#include "fmask.h"
+#include "util.h"
+
+/* Bitmap of permitted features */
+static uint8_t *bits = NULL;
+static feat_t bits_max = 0;
+
+/**
+ * Creates the bitmap from the dimensions of a feature vector. If the
+ * dimensions exceed FMASK_MAX_BITS bits, no bitmap is created and the
+ * features need to be filtered after extraction.
+ * @param fv Feature vector of permitted features
+ */
+void fmask_create(fvec_t *fv)
+{
+    unsigned long i;
+    feat_t max = 0;
+
+    fmask_destroy();
+
+    for (i = 0; i < fv->len; i++)
+        max = fv->dim[i] > max ? fv->dim[i] : max;
+
+    if ((uint64_t) max >> FMASK_MAX_BITS) {
+        info_msg(1, "Dimensions too large for early filtering of features.");
+        return;
+    }
+
+    bits = calloc(max / 8 + 1, 1);
+    if (!bits) {
+        error("Could not allocate bitmap of features");
+        return;
+    }
+
+    for (i = 0; i < fv->len; i++)
+        bits[fv->dim[i] >> 3] |= 1 << (fv->dim[i] & 7);
+    bits_max = max;
+}
+
+/**
+ * Destroys the bitmap of permitted features
+ */
+void fmask_destroy()
+{
+    free(bits);
+    bits = NULL;
+    bits_max = 0;
+}
+
+/**
+ * Checks whether the bitmap of permitted features is enabled
+ * @return 1 if enabled, 0 otherwise
+ */
+int fmask_enabled()
+{
+    return bits != NULL;
+}
+
+/**
+ * Checks whether a feature is permitted
+ * @param dim Dimension of feature
+ * @return 1 if permitted, 0 otherwise
+ */
+int fmask_test(feat_t dim)
+{
+    return dim <= bits_max && (bits[dim >> 3] >> (dim & 7)) & 1;
+}
+
+/** @} */
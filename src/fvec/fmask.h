@@ -0,0 +1,25 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+#ifndef FMASK_H
+#define FMASK_H
+
+#include "fvec.h"
+
+/** Maximum number of bits of dimensions covered by the bitmap */
+#define FMASK_MAX_BITS  32
+
+void fmask_create(fvec_t *fv);
+void fmask_destroy();
+int fmask_enabled();
+int fmask_test(feat_t dim);
+
+#endif /* FMASK_H */
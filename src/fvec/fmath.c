@@ -75,6 +75,7 @@ fvec_t *fvec_clone(fvec_t *o)
         fvec_destroy(fv);
         return NULL;
     }
+    fv->size = o->len;
 
     for (i = 0; i < o->len; i++) {
         fv->dim[i] = o->dim[i];
@@ -85,81 +86,146 @@ fvec_t *fvec_clone(fvec_t *o)
 }
 
 /** 
- * Adds one feature vector to another (a = a + b)
+ * Adds one feature vector to another (a = a + b). The lists of a are
+ * grown if necessary and both vectors are merged from the back, such
+ * that no temporary memory is required.
  * @param fa Feature vector (a)
  * @param fb Feature vector (b)
  */
 void fvec_add(fvec_t *fa, fvec_t *fb)
 {
-    unsigned long i = 0, j = 0, len = 0;
+    unsigned long i, j, k;
     assert(fa && fb);
-    feat_t *dim;
-    float *val;
 
-    /* Allocate arrays */
-    dim = (feat_t *) malloc((fa->len + fb->len) * sizeof(feat_t));
-    val = (float *) malloc((fa->len + fb->len) * sizeof(float));
-    if (!dim || !val) {
+    /* Adding a vector to itself */
+    if (fa == fb) {
+        fvec_mul(fa, 2.0);
+        return;
+    }
+
+    if (fb->len == 0)
+        return;
+
+    /* Grow arrays */
+    if (!fvec_reserve(fa, fa->len + fb->len)) {
         error("Could not allocate feature vector contents");
         return;
     }
 
-    /* Loop over features in a and b */
-    while (i < fa->len && j < fb->len) {
-        if (fa->dim[i] > fb->dim[j]) {
-            dim[len] = fb->dim[j];
-            val[len++] = (float) (fb->val[j++]);
-        } else if (fa->dim[i] < fb->dim[j]) {
-            dim[len] = fa->dim[i];
-            val[len++] = fa->val[i++];
+    /* Loop over features in a and b from the back */
+    i = fa->len, j = fb->len, k = fa->len + fb->len;
+    while (i > 0 && j > 0) {
+        if (fa->dim[i - 1] < fb->dim[j - 1]) {
+            fa->dim[--k] = fb->dim[--j];
+            fa->val[k] = fb->val[j];
+        } else if (fa->dim[i - 1] > fb->dim[j - 1]) {
+            fa->dim[--k] = fa->dim[--i];
+            fa->val[k] = fa->val[i];
         } else {
-            dim[len] = fa->dim[i];
-            val[len++] = (float) (fa->val[i++] + fb->val[j++]);
+            fa->dim[--k] = fa->dim[--i];
+            fa->val[k] = (float) (fa->val[i] + fb->val[--j]);
         }
     }
 
-    /* Loop over remaining features  */
-    while (j < fb->len) {
-        dim[len] = fb->dim[j];
-        val[len++] = (float) fb->val[j++];
+    /* Loop over remaining features */
+    while (j > 0) {
+        fa->dim[--k] = fb->dim[--j];
+        fa->val[k] = fb->val[j];
     }
-    while (i < fa->len) {
-        dim[len] = fa->dim[i];
-        val[len++] = fa->val[i++];
+    while (i > 0 && k > i) {
+        fa->dim[--k] = fa->dim[--i];
+        fa->val[k] = fa->val[i];
     }
+    k -= i;
 
-    /* Free old memory */
-    free(fa->dim);
-    free(fa->val);
-
-    /* Update */
-    fa->dim = dim;
-    fa->val = val;
-    fa->len = len;
+    /* Move merged features to the front (duplicates leave a gap) */
+    fa->len = fa->len + fb->len - k;
+    if (k > 0) {
+        memmove(fa->dim, fa->dim + k, fa->len * sizeof(feat_t));
+        memmove(fa->val, fa->val + k, fa->len * sizeof(float));
+    }
 
     /* Reallocate memory */
     fvec_realloc(fa);
 }
 
+/**
+ * Gallops to the first position in a sorted array of dimensions that is
+ * not smaller than a given key. Starting from a position, the step width
+ * is doubled until the key is passed and the remaining range is searched
+ * binary. The costs are logarithmic in the distance to the key.
+ * @param dim Sorted dimensions
+ * @param lo Start position
+ * @param len Length of array
+ * @param key Dimension to search
+ * @return position of key or of the next larger dimension
+ */
+static unsigned long fvec_gallop(feat_t *dim, unsigned long lo,
+                                 unsigned long len, feat_t key)
+{
+    unsigned long hi = lo, step = 1, mid;
+
+    while (hi < len && dim[hi] < key) {
+        lo = hi + 1;
+        hi += step;
+        step <<= 1;
+    }
+    if (hi > len)
+        hi = len;
+
+    while (lo < hi) {
+        mid = lo + ((hi - lo) >> 1);
+        if (dim[mid] < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * Checks whether galloping is preferable to merging for two vectors.
+ * @param a Length of the larger vector
+ * @param b Length of the smaller vector
+ * @return true if galloping should be used
+ */
+static int fvec_use_gallop(unsigned long a, unsigned long b)
+{
+    return a > FMATH_GALLOP_RATIO * b;
+}
+
 /** 
  * Element-wise multiplication of a feature vector with another (a = a x b).
- * The function uses a loop to compute the multiplication.
+ * The function merges both vectors without branching on the order of
+ * the dimensions and skips blocks of dimensions that can not match.
  * @param fa Feature vector (a)
  * @param fb Feature vector (b)
  */
 static void fvec_times_loop(fvec_t *fa, fvec_t *fb)
 {
-    unsigned long i = 0, j = 0;
+    unsigned long i = 0, j = 0, k;
 
     /* Loop over features in a and b */
     while (i < fa->len && j < fb->len) {
-        if (fa->dim[i] > fb->dim[j]) {
-            j++;
-        } else if (fa->dim[i] < fb->dim[j]) {
-            fa->val[i++] = 0.0;
-        } else {
-            fa->val[i++] *= fb->val[j++];
+        /* Skip blocks without matching dimensions */
+        if (i + FMATH_BLOCK <= fa->len &&
+            fa->dim[i + FMATH_BLOCK - 1] < fb->dim[j]) {
+            for (k = 0; k < FMATH_BLOCK; k++)
+                fa->val[i++] = 0.0;
+            continue;
         }
+        if (j + FMATH_BLOCK <= fb->len &&
+            fb->dim[j + FMATH_BLOCK - 1] < fa->dim[i]) {
+            j += FMATH_BLOCK;
+            continue;
+        }
+
+        feat_t x = fa->dim[i], y = fb->dim[j];
+        float f = x == y ? fb->val[j] : (x < y ? 0.0 : 1.0);
+        fa->val[i] *= f;
+        i += x <= y;
+        j += y <= x;
     }
 
     /* Zero-out remaining values in fa */
@@ -171,35 +237,21 @@ static void fvec_times_loop(fvec_t *fa, fvec_t *fb)
 
 /** 
  * Element-wise multiplication of a feature vector with another (a = a x b).
- * The function uses binary search to compute the multiplication. Note that
- * the elements can not be swapped for efficiency!
+ * The function gallops through b for each dimension of a. Note that the
+ * elements can not be swapped for efficiency!
  * @param fa Feature vector (a)
  * @param fb Feature vector (b)
  */
-static void fvec_times_bsearch(fvec_t *fa, fvec_t *fb)
+static void fvec_times_gallop(fvec_t *fa, fvec_t *fb)
 {
-    unsigned long i = 0, j = 0, p, q, k;
-    int found;
+    unsigned long i = 0, j;
 
     /* Loop over dimensions fa */
-    for (i = 0, j = 0; j < fa->len; j++) {
-        /* Binary search */
-        p = i, q = fb->len, found = FALSE;
-        do {
-            k = i, i = ((q - p) >> 1) + p;
-            if (fb->dim[i] > fa->dim[j]) {
-                q = i;
-            } else if (fb->dim[i] < fa->dim[j]) {
-                p = i;
-            } else {
-                fa->val[j] *= fb->val[i];
-                found = TRUE;
-                break;
-            }
-        } while (i != k);
-
-        /* No match. Zero-out value in fa */
-        if (!found)
+    for (j = 0; j < fa->len; j++) {
+        i = fvec_gallop(fb->dim, i, fb->len, fa->dim[j]);
+        if (i < fb->len && fb->dim[i] == fa->dim[j])
+            fa->val[j] *= fb->val[i];
+        else
             fa->val[j] = 0.0;
     }
 
@@ -214,16 +266,15 @@ static void fvec_times_bsearch(fvec_t *fa, fvec_t *fb)
 void fvec_times(fvec_t *fa, fvec_t *fb)
 {
     assert(fa && fb);
-    double a = fa->len, b = fb->len;
 
-    if (b <= 0) {
+    if (fb->len <= 0) {
         fvec_truncate(fa);
         return;
     }
 
     /* Choose times functions */
-    if (a + b > ceil(a * log2(b))) {
-        fvec_times_bsearch(fa, fb);
+    if (fvec_use_gallop(fb->len, fa->len)) {
+        fvec_times_gallop(fa, fb);
     } else {
         fvec_times_loop(fa, fb);
     }
@@ -234,14 +285,14 @@ void fvec_times(fvec_t *fa, fvec_t *fb)
 
 /** 
  * Dot product between two feature vectors (s = <a,b>). The function 
- * uses a binary search to sum over all dimensions.
+ * gallops through the larger vector for each dimension of the smaller.
  * @param fa Feature vector (a)
  * @param fb Feature vector (b)
  * @return s Inner product
  */
-static double fvec_dot_bsearch(fvec_t *fa, fvec_t *fb)
+static double fvec_dot_gallop(fvec_t *fa, fvec_t *fb)
 {
-    unsigned long i = 0, j = 0, p, q, k;
+    unsigned long i = 0, j;
     double s = 0;
 
     /* Check if fa is larger than fb */
@@ -251,20 +302,12 @@ static double fvec_dot_bsearch(fvec_t *fa, fvec_t *fb)
     }
 
     /* Loop over dimensions fb */
-    for (i = 0, j = 0; j < fb->len; j++) {
-        /* Binary search */
-        p = i, q = fa->len;
-        do {
-            k = i, i = ((q - p) >> 1) + p;
-            if (fa->dim[i] > fb->dim[j]) {
-                q = i;
-            } else if (fa->dim[i] < fb->dim[j]) {
-                p = i;
-            } else {
-                s += fa->val[i] * fb->val[j];
-                break;
-            }
-        } while (i != k);
+    for (j = 0; j < fb->len; j++) {
+        i = fvec_gallop(fa->dim, i, fa->len, fb->dim[j]);
+        if (i == fa->len)
+            break;
+        if (fa->dim[i] == fb->dim[j])
+            s += fa->val[i] * fb->val[j];
     }
 
     return s;
@@ -272,7 +315,8 @@ static double fvec_dot_bsearch(fvec_t *fa, fvec_t *fb)
 
 /** 
  * Dot product between two feature vectors (s = <a,b>). The function 
- * uses a loop to sum over all dimensions.
+ * merges both vectors without branching on the order of the dimensions
+ * and skips blocks of dimensions that can not match.
  * @param fa Feature vector (a)
  * @param fb Feature vector (b)
  * @return s Inner product
@@ -284,13 +328,22 @@ static double fvec_dot_loop(fvec_t *fa, fvec_t *fb)
 
     /* Loop over features in a and b */
     while (i < fa->len && j < fb->len) {
-        if (fa->dim[i] > fb->dim[j]) {
-            j++;
-        } else if (fa->dim[i] < fb->dim[j]) {
-            i++;
-        } else {
-            s += fa->val[i++] * fb->val[j++];
+        /* Skip blocks without matching dimensions */
+        if (i + FMATH_BLOCK <= fa->len &&
+            fa->dim[i + FMATH_BLOCK - 1] < fb->dim[j]) {
+            i += FMATH_BLOCK;
+            continue;
+        }
+        if (j + FMATH_BLOCK <= fb->len &&
+            fb->dim[j + FMATH_BLOCK - 1] < fa->dim[i]) {
+            j += FMATH_BLOCK;
+            continue;
         }
+
+        feat_t x = fa->dim[i], y = fb->dim[j];
+        s += x == y ? fa->val[i] * fb->val[j] : 0.0;
+        i += x <= y;
+        j += y <= x;
     }
 
     return s;
@@ -298,7 +351,7 @@ static double fvec_dot_loop(fvec_t *fa, fvec_t *fb)
 
 /** 
  * Dot product between two feature vectors (s = <a,b>). The function 
- * uses a loop or a binary search to sum over all dimensions depending
+ * uses a merge or a galloping search to sum over all dimensions depending
  * on the size of the considered vectors. The vectors need to be 
  * normalized, that is, ||a|| = 1.
  * @param fa Feature vector (a)
@@ -308,18 +361,11 @@ static double fvec_dot_loop(fvec_t *fa, fvec_t *fb)
 double fvec_dot(fvec_t *fa, fvec_t *fb)
 {
     assert(fa && fb);
-    double a, b;
-
-    /* Swap vectors according to size */
-    if (fa->len > fb->len) {
-        a = (double) fa->len, b = (double) fb->len;
-    } else {
-        b = (double) fa->len, a = (double) fb->len;
-    }
 
     /* Choose dot functions */
-    if (a + b > ceil(b * log2(a)))
-        return fvec_dot_bsearch(fa, fb);
+    if (fvec_use_gallop(fa->len, fb->len) ||
+        fvec_use_gallop(fb->len, fa->len))
+        return fvec_dot_gallop(fa, fb);
     else
         return fvec_dot_loop(fa, fb);
 }
@@ -15,6 +15,11 @@
 
 #include "fvec.h"
 
+/** Block of dimensions skipped at once when merging vectors */
+#define FMATH_BLOCK         4
+/** Minimum ratio of vector lengths for galloping instead of merging */
+#define FMATH_GALLOP_RATIO  16
+
 void fvec_binarize(fvec_t *fv);
 fvec_t *fvec_clone(fvec_t *);
 double fvec_dot(fvec_t *fa, fvec_t *fb);
@@ -0,0 +1,601 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+/**
+ * @addtogroup fvec Feature vector
+ * <hr>
+ * Principal component analysis of sparse feature vectors. The vectors
+ * are first mapped to a small sketch using the sparse random projection
+ * of the dimension reduction. In a pre-pass over the input the mean and
+ * the second moments of the sketches are accumulated, such that the
+ * memory only depends on the size of the sketch. The eigenvectors of
+ * the covariance matrix are computed with the Jacobi method and the
+ * components with the largest eigenvalues are stored as projection.
+ * During the dimension reduction each sketch is centered and projected
+ * onto these components.
+ * @author Konrad Rieck (konrad@mlsec.org)
+ * @{
+ */
+
+#include "config.h"
+#include "common.h"
+#include "fvec.h"
+#include "fpca.h"
+#include "fwindow.h"
+#include "reduce.h"
+#include "util.h"
+#include "input.h"
+
+/**
+ * Eigenvalue of a component
+ */
+typedef struct
+{
+    double val;             /**< Eigenvalue */
+    int idx;                /**< Index of eigenvector */
+} feig_t;
+
+/* External variables */
+extern config_t cfg;
+
+/* Projection onto principal components */
+static float *proj = NULL;
+static float *mean = NULL;
+static int proj_num = 0;
+static int sketch = 0;
+
+/* Moments of the pre-pass */
+static double *gram = NULL;
+static double *sum = NULL;
+static uint64_t count = 0;
+
+/**
+ * Checks whether the projection needs to be learned from the input, that
+ * is, principal component analysis is used for dimension reduction and
+ * no stored projection is available.
+ * @return 1 if learned, 0 otherwise
+ */
+int fpca_learn()
+{
+    const char *method, *file;
+
+    config_lookup_string(&cfg, "filter.dim_reduce", &method);
+    config_lookup_string(&cfg, "filter.pca_file", &file);
+
+    return !strcasecmp(method, "pca") &&
+        (strlen(file) == 0 || access(file, R_OK));
+}
+
+/**
+ * Initializes the moments for learning a projection
+ * @param m Size of sketch
+ */
+void fpca_init(int m)
+{
+    fpca_destroy();
+
+    sketch = m;
+    gram = calloc((size_t) m * m, sizeof(double));
+    sum = calloc(m, sizeof(double));
+    if (!gram || !sum)
+        fatal("Could not allocate moments for principal components");
+}
+
+/**
+ * Adds feature vectors to the moments. The vectors are replaced by
+ * their sketches in parallel and the products of all pairs of sketch
+ * dimensions are summed. Each thread handles different pairs, such that
+ * the result does not depend on the number of threads.
+ * @param x Array of feature vectors
+ * @param len Number of vectors
+ */
+void fpca_add(fvec_t **x, long len)
+{
+    long a, b, r;
+    float *y;
+
+    if (len <= 0)
+        return;
+
+    /* Sketches are stored by dimension */
+    y = calloc((size_t) len * sketch, sizeof(float));
+    if (!y) {
+        error("Could not allocate sketches for principal components");
+        return;
+    }
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for private(a)
+#endif
+    for (r = 0; r < len; r++) {
+        reduce_randproj(x[r], sketch);
+        if (x[r]->len != (unsigned long) sketch)
+            continue;
+        for (a = 0; a < sketch; a++)
+            y[a * len + r] = x[r]->val[a];
+    }
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for private(b, r) schedule(dynamic)
+#endif
+    for (a = 0; a < sketch; a++) {
+        const float *ya = y + a * len, *yb;
+        double s = 0;
+
+        for (r = 0; r < len; r++)
+            s += ya[r];
+        sum[a] += s;
+
+        for (b = a; b < sketch; b++) {
+            yb = y + b * len;
+            s = 0;
+#ifdef HAVE_OPENMP
+#pragma omp simd reduction(+:s)
+#endif
+            for (r = 0; r < len; r++)
+                s += (double) ya[r] * yb[r];
+            gram[a * sketch + b] += s;
+        }
+    }
+
+    count += len;
+    free(y);
+}
+
+/**
+ * Computes the eigenvalues and eigenvectors of a symmetric matrix using
+ * the cyclic Jacobi method. The matrix is diagonalized in place, such
+ * that the eigenvalues remain on its diagonal.
+ * @param a Symmetric matrix (row-major)
+ * @param v Matrix of eigenvectors (columns)
+ * @param n Number of rows and columns
+ */
+static void fpca_jacobi(double *a, double *v, int n)
+{
+    double off, norm, theta, t, c, s, x, y;
+    int i, p, q, k;
+
+    for (p = 0; p < n; p++)
+        for (q = 0; q < n; q++)
+            v[p * n + q] = p == q;
+
+    for (norm = 0, p = 0; p < n * n; p++)
+        norm += a[p] * a[p];
+
+    for (i = 0; i < FPCA_SWEEPS; i++) {
+        for (off = 0, p = 0; p < n; p++)
+            for (q = p + 1; q < n; q++)
+                off += a[p * n + q] * a[p * n + q];
+        if (off <= 1e-24 * norm)
+            break;
+
+        for (p = 0; p < n; p++) {
+            for (q = p + 1; q < n; q++) {
+                if (a[p * n + q] == 0)
+                    continue;
+
+                /* Rotation annihilating the entry (p,q) */
+                theta = (a[q * n + q] - a[p * n + p]) / (2 * a[p * n + q]);
+                t = 1 / (fabs(theta) + sqrt(theta * theta + 1));
+                t = theta < 0 ? -t : t;
+                c = 1 / sqrt(t * t + 1);
+                s = t * c;
+
+                for (k = 0; k < n; k++) {
+                    x = a[k * n + p], y = a[k * n + q];
+                    a[k * n + p] = c * x - s * y;
+                    a[k * n + q] = s * x + c * y;
+                }
+                for (k = 0; k < n; k++) {
+                    x = a[p * n + k], y = a[q * n + k];
+                    a[p * n + k] = c * x - s * y;
+                    a[q * n + k] = s * x + c * y;
+                }
+                for (k = 0; k < n; k++) {
+                    x = v[k * n + p], y = v[k * n + q];
+                    v[k * n + p] = c * x - s * y;
+                    v[k * n + q] = s * x + c * y;
+                }
+            }
+        }
+    }
+
+    if (i == FPCA_SWEEPS)
+        warning("Eigenvalues of principal components did not converge");
+}
+
+/**
+ * Compares two eigenvalues in descending order (for qsort)
+ * @param x Eigenvalue
+ * @param y Eigenvalue
+ * @return comparison
+ */
+static int cmp_eig(const void *x, const void *y)
+{
+    const feig_t *a = x, *b = y;
+
+    if (a->val != b->val)
+        return a->val < b->val ? 1 : -1;
+    return a->idx - b->idx;
+}
+
+/**
+ * Computes the projection from the accumulated moments. The components
+ * are sorted by their eigenvalues and the sign of each component is
+ * fixed, such that its largest entry is positive.
+ * @param num Number of components
+ */
+void fpca_finish(int num)
+{
+    double *cov = NULL, *vec = NULL, *mu = NULL, c, var = 0, top = 0;
+    feig_t *eig = NULL;
+    int a, b, i, k, m = sketch;
+
+    if (count == 0) {
+        error("No feature vectors for principal components");
+        goto out;
+    }
+
+    if (num > m)
+        num = m;
+
+    cov = malloc((size_t) m * m * sizeof(double));
+    vec = malloc((size_t) m * m * sizeof(double));
+    mu = malloc(m * sizeof(double));
+    eig = malloc(m * sizeof(feig_t));
+    proj = calloc((size_t) num * m, sizeof(float));
+    mean = malloc(m * sizeof(float));
+    if (!cov || !vec || !mu || !eig || !proj || !mean) {
+        error("Could not allocate principal components");
+        goto out;
+    }
+
+    for (a = 0; a < m; a++) {
+        mu[a] = sum[a] / count;
+        mean[a] = (float) mu[a];
+    }
+
+    for (a = 0; a < m; a++) {
+        for (b = a; b < m; b++) {
+            c = gram[a * m + b] / count - mu[a] * mu[b];
+            cov[a * m + b] = cov[b * m + a] = c;
+        }
+    }
+
+    fpca_jacobi(cov, vec, m);
+
+    for (a = 0; a < m; a++) {
+        eig[a].val = cov[a * m + a];
+        eig[a].idx = a;
+        var += eig[a].val;
+    }
+    qsort(eig, m, sizeof(feig_t), cmp_eig);
+
+    for (i = 0; i < num; i++) {
+        k = eig[i].idx;
+        top += eig[i].val;
+
+        for (b = 0, a = 1; a < m; a++)
+            if (fabs(vec[a * m + k]) > fabs(vec[b * m + k]))
+                b = a;
+        c = vec[b * m + k] < 0 ? -1 : 1;
+
+        for (a = 0; a < m; a++)
+            proj[i * m + a] = (float) (c * vec[a * m + k]);
+    }
+    proj_num = num;
+
+    info_msg(1, "Learned %d principal components (%.1f%% of variance).",
+             num, var > 0 ? 100 * top / var : 0.0);
+
+  out:
+    if (!proj_num) {
+        free(proj);
+        free(mean);
+        proj = mean = NULL;
+    }
+    free(cov);
+    free(vec);
+    free(mu);
+    free(eig);
+    free(gram);
+    free(sum);
+    gram = sum = NULL;
+    count = 0;
+}
+
+/**
+ * Accumulates the moments in a pre-pass over the input. The strings are
+ * preprocessed as for the embedding and the features of each chunk are
+ * extracted and post-processed in parallel. Sliding windows are added
+ * string by string.
+ * @param input Input source
+ */
+static void fpca_count_input(char *input)
+{
+    long read, entries, i, j, k, num;
+    cfg_int chunk;
+    const char *in_format;
+    fvec_t **wins;
+
+    config_lookup_string(&cfg, "input.input_format", &in_format);
+    config_lookup_int(&cfg, "input.chunk_size", &chunk);
+
+    /* Standard input can only be read once */
+    if (!strcasecmp(in_format, "stdin"))
+        fatal("Principal components can not be learned from standard input.");
+
+    string_t *strs = malloc(sizeof(string_t) * chunk);
+    fvec_t **fvec = malloc(sizeof(fvec_t *) * chunk);
+    if (!strs || !fvec) {
+        error("Could not allocate memory for principal components");
+        goto out;
+    }
+
+    input_config(in_format);
+    entries = input_open(input);
+    if (entries <= 0) {
+        error("Could not open input for learning principal components");
+        goto out;
+    }
+
+    info_msg(1, "Learning principal components from %d strings in chunks "
+             "of %d.", entries, chunk);
+
+    for (i = 0, read = 0; i < entries; i += read) {
+        read = input_read(strs, chunk);
+        if (read <= 0)
+            break;
+
+        /* Preprocess strings as for the embedding */
+        input_preproc(strs, read);
+
+        for (j = 0; fwindow_enabled() && j < read; j++) {
+            wins = fwindow_extract(strs[j].str, strs[j].len, &num);
+            for (k = 0; k < num; k++)
+                fvec_postprocess(wins[k]);
+            fpca_add(wins, num);
+            for (k = 0; k < num; k++)
+                fvec_destroy(wins[k]);
+            free(wins);
+        }
+
+        if (!fwindow_enabled()) {
+#ifdef HAVE_OPENMP
+#pragma omp parallel for
+#endif
+            for (j = 0; j < read; j++)
+                fvec[j] = fvec_extract(strs[j].str, strs[j].len);
+
+            fpca_add(fvec, read);
+            for (j = 0; j < read; j++)
+                fvec_destroy(fvec[j]);
+        }
+
+        input_free(strs, read);
+        prog_bar(0, entries, i + read);
+    }
+
+    input_close();
+
+  out:
+    free(strs);
+    free(fvec);
+}
+
+/**
+ * Saves the projection to a file. The first vector holds the mean of the
+ * sketches, the number of components and the sparsity of the sketch. It
+ * is followed by one vector per component.
+ * @param file File name
+ */
+static void fpca_save(const char *file)
+{
+    cfg_int sparsity;
+    fvec_t *fv;
+    gzFile z;
+    int i, j;
+
+    config_lookup_int(&cfg, "filter.randproj_sparsity", &sparsity);
+
+    z = gzopen(file, "w9");
+    fv = fvec_zero();
+    if (!z || !fv || !fvec_reserve(fv, sketch)) {
+        error("Could not save principal components to '%s'.", file);
+        goto out;
+    }
+
+    for (j = 0; j < sketch; j++)
+        fv->dim[j] = j;
+    fv->len = sketch;
+
+    for (i = -1; i < proj_num; i++) {
+        for (j = 0; j < sketch; j++)
+            fv->val[j] = i < 0 ? mean[j] : proj[i * sketch + j];
+        fv->total = i < 0 ? proj_num : 0;
+        fv->label = i < 0 ? sparsity : 0;
+        fvec_write(fv, z);
+    }
+
+  out:
+    if (z)
+        gzclose(z);
+    fvec_destroy(fv);
+}
+
+/**
+ * Loads the projection from a file. Only the first components are used
+ * if more components are stored than requested.
+ * @param file File name
+ * @param num Number of components
+ */
+static void fpca_load(const char *file, int num)
+{
+    cfg_int sparsity;
+    fvec_t *fv;
+    gzFile z;
+    int i, j;
+
+    config_lookup_int(&cfg, "filter.randproj_sparsity", &sparsity);
+
+    z = gzopen(file, "r");
+    if (!z)
+        fatal("Could not open '%s' for reading.", file);
+
+    fv = fvec_read(z);
+    if (!fv || fv->len != (unsigned long) sketch || fv->label != sparsity)
+        fatal("Principal components in '%s' do not match sketch.", file);
+
+    if (fv->total < (unsigned long) num)
+        warning("Only %lu principal components in '%s'.", fv->total, file);
+
+    proj_num = fv->total < (unsigned long) num ? fv->total : num;
+    proj = calloc((size_t) proj_num * sketch + 1, sizeof(float));
+    mean = calloc(sketch, sizeof(float));
+    if (!proj || !mean)
+        fatal("Could not allocate principal components");
+
+    for (i = -1; fv && i < proj_num; i++) {
+        for (j = 0; j < fv->len; j++) {
+            if (fv->dim[j] >= (feat_t) sketch)
+                continue;
+            if (i < 0)
+                mean[fv->dim[j]] = fv->val[j];
+            else
+                proj[i * sketch + fv->dim[j]] = fv->val[j];
+        }
+        fvec_destroy(fv);
+        fv = i + 1 < proj_num ? fvec_read(z) : NULL;
+    }
+
+    if (i < proj_num)
+        fatal("Could not read principal components from '%s'.", file);
+
+    gzclose(z);
+}
+
+/**
+ * Loads or learns the projection onto principal components. If the file
+ * does not exist, the projection is learned from the input and saved to
+ * the file.
+ * @param input Input source
+ */
+void fpca_create(char *input)
+{
+    const char *method, *file;
+    cfg_int num, m;
+
+    config_lookup_string(&cfg, "filter.dim_reduce", &method);
+    config_lookup_string(&cfg, "filter.pca_file", &file);
+    config_lookup_int(&cfg, "filter.dim_num", &num);
+    config_lookup_int(&cfg, "filter.pca_sketch", &m);
+
+    if (strcasecmp(method, "pca"))
+        return;
+
+    if (!fpca_learn()) {
+        info_msg(1, "Loading principal components from '%s'.", file);
+        fpca_destroy();
+        sketch = m;
+        fpca_load(file, num);
+        return;
+    }
+
+    fpca_init(m);
+    fpca_count_input(input);
+    fpca_finish(num);
+
+    if (!proj || strlen(file) == 0)
+        return;
+
+    info_msg(1, "Saving %d principal components to '%s'.", proj_num, file);
+    fpca_save(file);
+}
+
+/**
+ * Destroys the projection and the moments
+ */
+void fpca_destroy()
+{
+    free(proj);
+    free(mean);
+    free(gram);
+    free(sum);
+    proj = mean = NULL;
+    gram = sum = NULL;
+    proj_num = 0;
+    count = 0;
+}
+
+/**
+ * Checks whether a projection is available
+ * @return 1 if enabled, 0 otherwise
+ */
+int fpca_enabled()
+{
+    return proj != NULL;
+}
+
+/**
+ * Projects a feature vector onto the principal components. The vector is
+ * replaced by its centered sketch and then by the dense projection.
+ * @param fv Feature vector
+ */
+void fpca_project(fvec_t *fv)
+{
+    feat_t *dim;
+    float *val, s;
+    int i, j;
+
+    if (!proj) {
+        warning("No principal components for dimension reduction.");
+        return;
+    }
+
+    reduce_randproj(fv, sketch);
+    if (fv->len != (unsigned long) sketch)
+        return;
+
+    dim = (feat_t *) malloc(proj_num * sizeof(feat_t) + 1);
+    val = (float *) malloc(proj_num * sizeof(float) + 1);
+    if (!dim || !val) {
+        error("Could not allocate feature vector contents");
+        free(dim);
+        free(val);
+        return;
+    }
+
+    for (j = 0; j < sketch; j++)
+        fv->val[j] -= mean[j];
+
+    for (i = 0; i < proj_num; i++) {
+        const float *p = proj + i * sketch;
+        s = 0;
+#ifdef HAVE_OPENMP
+#pragma omp simd reduction(+:s)
+#endif
+        for (j = 0; j < sketch; j++)
+            s += p[j] * fv->val[j];
+        dim[i] = i;
+        val[i] = s;
+    }
+
+    /* Exchange data */
+    free(fv->dim);
+    free(fv->val);
+
+    fv->dim = dim;
+    fv->val = val;
+    fv->len = proj_num;
+    fv->size = proj_num;
+}
+
+/** @} */
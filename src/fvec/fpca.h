@@ -0,0 +1,29 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+#ifndef FPCA_H
+#define FPCA_H
+
+#include "fvec.h"
+
+/** Maximum number of sweeps of the Jacobi eigenvalue method */
+#define FPCA_SWEEPS     64
+
+int fpca_learn();
+void fpca_create(char *input);
+void fpca_destroy();
+int fpca_enabled();
+void fpca_init(int sketch);
+void fpca_add(fvec_t **x, long len);
+void fpca_finish(int num);
+void fpca_project(fvec_t *fv);
+
+#endif /* FPCA_H */
@@ -0,0 +1,508 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+/**
+ * @addtogroup fvec Feature vector
+ * <hr>
+ * Label-aware feature selection. In a pre-pass over the input the
+ * document frequencies of the features are counted for each label and
+ * the features are scored by their chi-squared statistic or mutual
+ * information with the label. The features with the highest scores
+ * are stored as a mask, that is, a feature vector of the selected
+ * dimensions and their scores. During extraction all other features
+ * are dropped.
+ * @author Konrad Rieck (konrad@mlsec.org)
+ * @{
+ */
+
+#include "config.h"
+#include "common.h"
+#include "fvec.h"
+#include "fhash.h"
+#include "fselect.h"
+#include "vocab.h"
+#include "fmask.h"
+#include "util.h"
+#include "input.h"
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * Key of a counter: feature and index of label
+ */
+typedef struct
+{
+    feat_t dim;             /**< Feature */
+    uint32_t label;         /**< Index of label */
+} fkey_t;
+
+/**
+ * Document frequency of a feature for a label
+ */
+typedef struct
+{
+    fkey_t key;             /**< Feature and label */
+    uint64_t cnt;           /**< Document frequency */
+    UT_hash_handle hh;      /**< Uthash handle */
+} fcount_t;
+
+/**
+ * Score of a feature
+ */
+typedef struct
+{
+    feat_t dim;             /**< Feature */
+    double score;           /**< Score */
+} fscore_t;
+
+/* External variables */
+extern config_t cfg;
+
+/* Mask of selected features */
+static fvec_t *mask = NULL;
+
+/* Counters of the pre-pass (merged and of each thread) */
+static fcount_t *table = NULL;
+static fcount_t **tables = NULL;
+static int tables_len = 0;
+static unsigned long table_len = 0;
+static float labels[FSELECT_LABELS];
+static uint64_t label_cnt[FSELECT_LABELS];
+static int labels_len = 0;
+
+/**
+ * Returns the index of a label. New labels are appended.
+ * @param l Label
+ * @return index of label
+ */
+static int label_index(float l)
+{
+    int i;
+
+    for (i = 0; i < labels_len; i++)
+        if (labels[i] == l)
+            return i;
+
+    if (labels_len == FSELECT_LABELS)
+        fatal("Too many labels for feature selection (max. %d)",
+              FSELECT_LABELS);
+
+    labels[labels_len] = l;
+    return labels_len++;
+}
+
+/**
+ * Counts the features of a vector for a label in the table of the
+ * calling thread.
+ * @param fv Feature vector
+ * @param label Index of label
+ */
+static void fselect_count(fvec_t *fv, int label)
+{
+    unsigned long i;
+    fcount_t *c, **map;
+    fkey_t key;
+
+#ifdef HAVE_OPENMP
+    map = tables + omp_get_thread_num();
+#else
+    map = tables;
+#endif
+
+    memset(&key, 0, sizeof(fkey_t));
+    key.label = label;
+
+    for (i = 0; i < fv->len; i++) {
+        key.dim = fv->dim[i];
+        HASH_FIND(hh, *map, &key, sizeof(fkey_t), c);
+        if (!c) {
+            c = calloc(1, sizeof(fcount_t));
+            if (!c)
+                fatal("Could not allocate counters for feature selection");
+            c->key = key;
+            HASH_ADD(hh, *map, key, sizeof(fkey_t), c);
+        }
+        c->cnt++;
+    }
+}
+
+/**
+ * Merges the tables of all threads into one table of counters
+ */
+static void fselect_merge()
+{
+    fcount_t *c, *d;
+    int t;
+
+    for (t = 0; t < tables_len; t++) {
+        while (tables[t]) {
+            c = tables[t];
+            HASH_DEL(tables[t], c);
+            HASH_FIND(hh, table, &c->key, sizeof(fkey_t), d);
+            if (!d) {
+                HASH_ADD(hh, table, key, sizeof(fkey_t), c);
+                table_len++;
+                continue;
+            }
+            d->cnt += c->cnt;
+            free(c);
+        }
+    }
+}
+
+/**
+ * Chi-squared statistic of a feature and a label
+ * @param n Number of documents
+ * @param nf Documents containing the feature
+ * @param nc Documents with the label
+ * @param a Documents containing the feature with the label
+ * @return statistic
+ */
+static double score_chi2(double n, double nf, double nc, double a)
+{
+    double b = nf - a, c = nc - a, d = n - nf - nc + a;
+    double den = nf * (n - nf) * nc * (n - nc);
+
+    return den > 0 ? n * (a * d - b * c) * (a * d - b * c) / den : 0;
+}
+
+/**
+ * Contribution of a label to the mutual information between the
+ * occurrence of a feature and the label
+ * @param n Number of documents
+ * @param nf Documents containing the feature
+ * @param nc Documents with the label
+ * @param a Documents containing the feature with the label
+ * @return mutual information
+ */
+static double score_mi(double n, double nf, double nc, double a)
+{
+    double s = 0, b = nc - a;
+
+    if (a > 0)
+        s += a / n * log(n * a / (nf * nc));
+    if (b > 0)
+        s += b / n * log(n * b / ((n - nf) * nc));
+
+    return s;
+}
+
+/**
+ * Compares two counters by feature and label (for qsort)
+ * @param x Counter
+ * @param y Counter
+ * @return comparison
+ */
+static int cmp_key(const void *x, const void *y)
+{
+    const fcount_t *a = *(fcount_t **) x, *b = *(fcount_t **) y;
+
+    if (a->key.dim != b->key.dim)
+        return a->key.dim > b->key.dim ? 1 : -1;
+    return (a->key.label > b->key.label) - (a->key.label < b->key.label);
+}
+
+/**
+ * Compares two scores in descending order (for qsort)
+ * @param x Score
+ * @param y Score
+ * @return comparison
+ */
+static int cmp_score(const void *x, const void *y)
+{
+    const fscore_t *a = x, *b = y;
+
+    if (a->score != b->score)
+        return a->score < b->score ? 1 : -1;
+    return (a->dim > b->dim) - (a->dim < b->dim);
+}
+
+/**
+ * Compares two scores by feature (for qsort)
+ * @param x Score
+ * @param y Score
+ * @return comparison
+ */
+static int cmp_dim(const void *x, const void *y)
+{
+    const fscore_t *a = x, *b = y;
+    return (a->dim > b->dim) - (a->dim < b->dim);
+}
+
+/**
+ * Scores the counted features and selects the features with the
+ * highest scores as mask. The chi-squared statistic is maximized over
+ * the labels, while the mutual information is summed.
+ * @param num Number of features to select
+ * @param chi2 Use chi-squared statistic instead of mutual information
+ */
+static void fselect_score(unsigned long num, int chi2)
+{
+    unsigned long i, j, k, len = 0;
+    uint64_t n = 0, a[FSELECT_LABELS], nf;
+    fcount_t **counts, *c;
+    fscore_t *scores;
+    double s, x;
+    int l;
+
+    counts = malloc(table_len * sizeof(fcount_t *));
+    scores = malloc(table_len * sizeof(fscore_t));
+    if (!counts || !scores) {
+        error("Could not allocate scores for feature selection");
+        goto out;
+    }
+
+    for (i = 0, c = table; c; c = c->hh.next)
+        counts[i++] = c;
+    qsort(counts, table_len, sizeof(fcount_t *), cmp_key);
+
+    for (l = 0; l < labels_len; l++)
+        n += label_cnt[l];
+    memset(a, 0, sizeof(a));
+
+    /* Loop over groups of counters with the same feature */
+    for (i = 0; i < table_len; i = j) {
+        nf = 0;
+        for (j = i; j < table_len && counts[j]->key.dim == counts[i]->key.dim;
+             j++) {
+            a[counts[j]->key.label] = counts[j]->cnt;
+            nf += counts[j]->cnt;
+        }
+
+        for (s = 0, l = 0; l < labels_len; l++) {
+            if (chi2) {
+                x = score_chi2(n, nf, label_cnt[l], a[l]);
+                s = x > s ? x : s;
+            } else {
+                s += score_mi(n, nf, label_cnt[l], a[l]);
+            }
+        }
+
+        for (k = i; k < j; k++)
+            a[counts[k]->key.label] = 0;
+
+        scores[len].dim = counts[i]->key.dim;
+        scores[len++].score = s;
+    }
+
+    if (num > len)
+        num = len;
+
+    qsort(scores, len, sizeof(fscore_t), cmp_score);
+    qsort(scores, num, sizeof(fscore_t), cmp_dim);
+
+    mask = fvec_zero();
+    if (!mask || !fvec_reserve(mask, num)) {
+        error("Could not allocate mask of selected features");
+        goto out;
+    }
+
+    for (i = 0; i < num; i++) {
+        mask->dim[i] = scores[i].dim;
+        mask->val[i] = (float) scores[i].score;
+    }
+    mask->len = num;
+
+  out:
+    free(counts);
+    free(scores);
+}
+
+/**
+ * Counts the features for each label in a pre-pass over the input. The
+ * features of each chunk are extracted and counted in parallel, where
+ * each thread uses its own table. The tables are merged at the end.
+ * @param input Input source
+ */
+static void fselect_count_input(char *input)
+{
+    long read, entries, i, j;
+    cfg_int chunk;
+    const char *in_format;
+    int *label;
+
+    config_lookup_string(&cfg, "input.input_format", &in_format);
+    config_lookup_int(&cfg, "input.chunk_size", &chunk);
+
+    /* Standard input can only be read once */
+    if (!strcasecmp(in_format, "stdin"))
+        fatal("Features can not be selected from standard input.");
+
+#ifdef HAVE_OPENMP
+    tables_len = omp_get_max_threads();
+#else
+    tables_len = 1;
+#endif
+
+    string_t *strs = malloc(sizeof(string_t) * chunk);
+    label = malloc(sizeof(int) * chunk);
+    tables = calloc(tables_len, sizeof(fcount_t *));
+    if (!strs || !label || !tables) {
+        error("Could not allocate memory for feature selection");
+        goto out;
+    }
+
+    input_config(in_format);
+    entries = input_open(input);
+    if (entries <= 0) {
+        error("Could not open input for selecting features");
+        goto out;
+    }
+
+    info_msg(1, "Counting features of %d strings in chunks of %d.",
+             entries, chunk);
+
+    for (i = 0, read = 0; i < entries; i += read) {
+        read = input_read(strs, chunk);
+        if (read <= 0)
+            break;
+
+        /* Preprocess strings as for the embedding */
+        input_preproc(strs, read);
+
+        /* Labels are indexed in order of their appearance */
+        for (j = 0; j < read; j++) {
+            label[j] = label_index(strs[j].label);
+            label_cnt[label[j]]++;
+        }
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for
+#endif
+        for (j = 0; j < read; j++) {
+            fvec_t *fv = fvec_extract_intern(strs[j].str, strs[j].len);
+            fselect_count(fv, label[j]);
+            fvec_destroy(fv);
+        }
+
+        input_free(strs, read);
+        prog_bar(0, entries, i + read);
+    }
+
+    input_close();
+    fselect_merge();
+
+  out:
+    free(strs);
+    free(label);
+    free(tables);
+    tables = NULL;
+    tables_len = 0;
+}
+
+/**
+ * Loads or determines the mask of selected features. If the file does
+ * not exist, the features are scored using the labels of the input and
+ * the mask is saved to the file.
+ * @param input Input source
+ */
+void fselect_create(char *input)
+{
+    const char *select_file, *method;
+    fcount_t *c;
+    cfg_int num;
+
+    config_lookup_string(&cfg, "features.select_file", &select_file);
+    config_lookup_string(&cfg, "features.select_method", &method);
+    config_lookup_int(&cfg, "features.select_num", &num);
+
+    if (!access(select_file, R_OK)) {
+        info_msg(1, "Loading selected features from '%s'.", select_file);
+        mask = fvec_load((char *) select_file);
+    } else {
+        fselect_count_input(input);
+        if (labels_len < 2)
+            warning("Less than two labels in input. All scores are zero.");
+        fselect_score(num, !strcasecmp(method, "chi2"));
+
+        /* Free counters */
+        while (table) {
+            c = table;
+            HASH_DEL(table, c);
+            free(c);
+        }
+        table_len = 0;
+        labels_len = 0;
+        memset(label_cnt, 0, sizeof(label_cnt));
+
+        if (!mask)
+            return;
+
+        info_msg(1, "Saving %lu selected features to '%s'.", mask->len,
+                 select_file);
+        fvec_save(mask, (char *) select_file);
+    }
+
+    /* Drop other features already during extraction. With a vocabulary
+       the selected dimensions are filtered after the mapping instead. */
+    if (mask && !vocab_enabled())
+        fmask_create(mask);
+}
+
+/**
+ * Destroys the mask of selected features
+ */
+void fselect_destroy()
+{
+    if (mask && !vocab_enabled())
+        fmask_destroy();
+    fvec_destroy(mask);
+    mask = NULL;
+}
+
+/**
+ * Checks whether features are selected
+ * @return 1 if enabled, 0 otherwise
+ */
+int fselect_enabled()
+{
+    return mask != NULL;
+}
+
+/**
+ * Returns the number of selected features
+ * @return number of features
+ */
+unsigned long fselect_size()
+{
+    return mask ? mask->len : 0;
+}
+
+/**
+ * Drops all features of a vector that are not selected. As both lists
+ * are sorted, the search for each feature starts at the previous match.
+ * @param fv Feature vector
+ */
+void fselect_filter(fvec_t *fv)
+{
+    unsigned long i, j = 0, lo = 0, hi, mid;
+
+    for (i = 0; i < fv->len; i++) {
+        hi = mask->len;
+        while (lo < hi) {
+            mid = lo + ((hi - lo) >> 1);
+            if (mask->dim[mid] < fv->dim[i])
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        fv->dim[j] = fv->dim[i];
+        fv->val[j] = fv->val[i];
+        j += lo < mask->len && mask->dim[lo] == fv->dim[i];
+    }
+
+    fv->len = j;
+}
+
+/** @} */
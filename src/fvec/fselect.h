@@ -0,0 +1,26 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+#ifndef FSELECT_H
+#define FSELECT_H
+
+#include "fvec.h"
+
+/** Maximum number of distinct labels for feature selection */
+#define FSELECT_LABELS  256
+
+void fselect_create(char *input);
+void fselect_destroy();
+int fselect_enabled();
+void fselect_filter(fvec_t *fv);
+unsigned long fselect_size();
+
+#endif /* FSELECT_H */
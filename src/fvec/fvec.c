@@ -37,6 +37,10 @@
 #include "sally.h"
 #include "norm.h"
 #include "embed.h"
+#include "vocab.h"
+#include "fdict.h"
+#include "fselect.h"
+#include "fmask.h"
 
 /* External variables */
 extern int verbose;
@@ -44,15 +48,17 @@ extern config_t cfg;
 
 /* Local functions */
 static inline void extract_token_ngrams(fvec_t *, char *x, int l, int nlen,
-                                        int pos, int shift);
+                                        int pos, int shift, fsink_t *sink);
 static inline void extract_byte_ngrams(fvec_t *, char *x, int l, int nlen,
-                                       int pos, int shift);
+                                       int pos, int shift, fsink_t *sink);
+static void extract_ngrams(fvec_t *fv, char *x, int l, int n,
+                           fsink_t *sink);
 static inline void count_feat(fvec_t *fv);
 static inline int cmp_feat(const void *x, const void *y);
 static inline void cache_put(fentry_t *c, fvec_t *fv, char *t, int l);
 static inline void cache_flush(fentry_t *c, int l);
-static inline void fvec_postprocess(fvec_t *fv);
-static inline fvec_t *fvec_extract_intern2(char *x, int l, int n);
+static int write_vals(float *val, unsigned long len, int enc, gzFile z);
+static int read_vals(float *val, unsigned long len, int enc, gzFile z);
 
 /* Global delimiter table */
 char delim[256] = { DELIM_NOT_INIT };
@@ -116,7 +122,6 @@ fvec_t *fvec_extract_intern2(char *x, int l, int n)
     fvec_t *fv;
     int pos;
     cfg_int shift;
-    const char *granu;
     assert(x && l >= 0 && n > 0);
 
     /* Allocate feature vector */
@@ -127,7 +132,6 @@ fvec_t *fvec_extract_intern2(char *x, int l, int n)
     }
 
     /* Get configuration */
-    config_lookup_string(&cfg, "features.granularity", &granu);
     config_lookup_bool(&cfg, "features.ngram_pos", &pos);
     config_lookup_int(&cfg, "features.pos_shift", &shift);
 
@@ -149,49 +153,126 @@ fvec_t *fvec_extract_intern2(char *x, int l, int n)
         fvec_destroy(fv);
         return NULL;
     }
+    fv->size = l * space;
+
+    /* Extract n-grams */
+    extract_ngrams(fv, x, l, n, NULL);
+
+    /* Sort extracted features */
+    qsort(fv->dim, fv->len, sizeof(feat_t), cmp_feat);
+
+    /* Count features  */
+    count_feat(fv);
+
+    /* Map features to vocabulary */
+    if (vocab_enabled())
+        vocab_map(fv);
+
+    /* Keep only selected features */
+    if (fselect_enabled())
+        fselect_filter(fv);
+
+    return fv;
+}
+
+/**
+ * Extracts the n-grams of a string for all position shifts. The
+ * features are either stored in the feature vector or handed over to
+ * a sink.
+ * @param fv Feature vector
+ * @param x String of bytes
+ * @param l Length of string
+ * @param n N-gram length
+ * @param sink Sink for features (NULL = store in vector)
+ */
+static void extract_ngrams(fvec_t *fv, char *x, int l, int n, fsink_t *sink)
+{
+    int pos;
+    cfg_int shift;
+    const char *granu;
+
+    config_lookup_string(&cfg, "features.granularity", &granu);
+    config_lookup_bool(&cfg, "features.ngram_pos", &pos);
+    config_lookup_int(&cfg, "features.pos_shift", &shift);
+
+    /* Sanitize shift value */
+    if (!pos)
+        shift = 0;
 
     /* Loop over position shifts (0 if pos is disabled) */
     for (int s = -shift; s <= shift; s++) {
         if (!strcasecmp(granu, "bytes")) {
-            extract_byte_ngrams(fv, x, l, n, pos, s);
+            extract_byte_ngrams(fv, x, l, n, pos, s, sink);
         } else if (!strcasecmp(granu, "tokens")) {
-            extract_token_ngrams(fv, x, l, n, pos, s);
+            extract_token_ngrams(fv, x, l, n, pos, s, sink);
         } else {
             error("Unknown granularity '%s'. Using 'bytes'.", granu);
-            extract_byte_ngrams(fv, x, l, n, pos, s);            
+            extract_byte_ngrams(fv, x, l, n, pos, s, sink);
         }
     }
+}
 
-    /* Sort extracted features */
-    qsort(fv->dim, fv->len, sizeof(feat_t), cmp_feat);
+/**
+ * Extracts the features of a string and hands them over to a sink one
+ * by one. No feature vector is allocated and the features are neither
+ * sorted nor counted, such that duplicates reach the sink repeatedly.
+ * Blended n-grams are supported. This fused path serves reductions
+ * that only depend on the set of features.
+ * @param x String of bytes (with space delimiters)
+ * @param l Length of sequence
+ * @param sink Sink for features
+ * @return total number of n-grams (as in fvec_t)
+ */
+unsigned long fvec_extract_sink(char *x, int l, fsink_t *sink)
+{
+    int blend;
+    cfg_int i, n;
+    feat_t dim;
+    float val;
+    fvec_t fv;
 
-    /* Count features  */
-    count_feat(fv);
+    config_lookup_bool(&cfg, "features.ngram_blend", &blend);
+    config_lookup_int(&cfg, "features.ngram_len", &n);
 
-    return fv;
+    if (l == 0)
+        return 0;
+
+    /* Single slot used as scratch space by the extraction */
+    memset(&fv, 0, sizeof(fvec_t));
+    fv.dim = &dim;
+    fv.val = &val;
+    fv.size = 1;
+
+    /* Blended n-grams do not add to the total as in fvec_add() */
+    for (i = blend ? 1 : n; i <= n; i++) {
+        fv.total = 0;
+        extract_ngrams(&fv, x, l, i, sink);
+    }
+
+    return fv.total;
 }
 
 /**
- * Internal post-processing of feature vectors.
+ * Internal post-processing of feature vectors. The embedding,
+ * normalization and thresholding are computed by a fused kernel.
  * @param fv feature vector
  */
 void fvec_postprocess(fvec_t *fv)
 {
-    const char *cfg_str;
+    const char *embed, *norm, *enc;
     double flt1, flt2;
 
-    /* Compute embedding and normalization */
-    config_lookup_string(&cfg, "features.vect_embed", &cfg_str);
-    fvec_embed(fv, cfg_str);
-    config_lookup_string(&cfg, "features.vect_norm", &cfg_str);
-    fvec_norm(fv, cfg_str);
-
-    /* Apply thresholding */
+    config_lookup_string(&cfg, "features.vect_embed", &embed);
+    config_lookup_string(&cfg, "features.vect_norm", &norm);
+    config_lookup_string(&cfg, "features.vect_enc", &enc);
     config_lookup_float(&cfg, "features.thres_low", &flt1);
     config_lookup_float(&cfg, "features.thres_high", &flt2);
-    if (flt1 != 0.0 || flt2 != 0.0) {
-        fvec_thres(fv, flt1, flt2);
-    }
+
+    /* Compute embedding, normalization and thresholding */
+    fvec_embed_norm(fv, embed, norm, flt1, flt2);
+
+    /* Saturate counts to a fixed encoding */
+    fvec_saturate(fv, fvec_enc_parse(enc));
 }
 
 /**
@@ -211,6 +292,7 @@ void fvec_truncate(fvec_t *const fv)
     assert(fv != NULL);
 
     fv->len = 0;
+    fv->size = 0;
     if (fv->dim)
         free(fv->dim);
     if (fv->val)
@@ -253,6 +335,9 @@ static void cache_flush(fentry_t *c, int l)
 #endif
     {
         for (i = 0; i < l; i++) {
+            /* Skip dropped features */
+            if (!c[i].data)
+                continue;
             fhash_put(c[i].key, c[i].data, c[i].len);
             free(c[i].data);
         }
@@ -356,10 +441,10 @@ static char *sort_tokens(char *str, int len, char delim)
  * @param shift Shift value
  */
 static void extract_token_ngrams(fvec_t *fv, char *x, int l, int nlen,
-                                 int pos, int shift)
+                                 int pos, int shift, fsink_t *sink)
 {
     assert(fv && x && l > 0);
-    int sort, sign, flen;
+    int sort, sign, flen, keep;
     cfg_int bits;
     unsigned int i, j = l, ci = 0;
     unsigned int dlm = 0;
@@ -428,16 +513,31 @@ static void extract_token_ngrams(fvec_t *fv, char *x, int l, int nlen,
             fv->dim[fv->len] = h & hash_mask;
             fv->val[fv->len] = 1;
 
+            /* Map feature to dictionary */
+            if (fdict_enabled())
+                fv->dim[fv->len] = fdict_id(fstr, flen, h);
+
+            /* Drop features missing in dictionary or not permitted */
+            keep = !fdict_enabled() || fv->dim[fv->len] != FDICT_NONE;
+            keep &= !fmask_enabled() || fmask_test(fv->dim[fv->len]);
+
             /* Signed embedding */
             if (sign)
                 fv->val[fv->len] *= (signed) h > 0 ? -1 : 1;
 
             /* Cache feature and key */
-            if (fhash_enabled())
+            if (fhash_enabled() && keep)
                 cache_put(&cache[ci], fv, fstr, flen);
 
+            /* Hand feature over to sink */
+            if (sink && keep) {
+                sink->put(sink->ctx, fv->dim[fv->len]);
+                fv->total++;
+            } else {
+                fv->len += keep;
+            }
+
             fstart = fnext + 1, i = fnext, fnum = 0;
-            fv->len++;
             ci++;
             free(fstr);
         }
@@ -466,12 +566,12 @@ static void extract_token_ngrams(fvec_t *fv, char *x, int l, int nlen,
  * @param shift Shift value
  */
 static void extract_byte_ngrams(fvec_t *fv, char *x, int l, int nlen, int pos,
-                                int shift)
+                                int shift, fsink_t *sink)
 {
     assert(fv && x);
 
     unsigned int i = 0, ci = 0;
-    int sort, flen, sign;
+    int sort, flen, sign, keep;
     cfg_int bits;
     char *fstr, *t = x;
     fentry_t *cache = NULL;
@@ -512,16 +612,31 @@ static void extract_byte_ngrams(fvec_t *fv, char *x, int l, int nlen, int pos,
         fv->dim[fv->len] = h & hash_mask;
         fv->val[fv->len] = 1;
 
+        /* Map feature to dictionary */
+        if (fdict_enabled())
+            fv->dim[fv->len] = fdict_id(fstr, flen, h);
+
+        /* Drop features missing in dictionary or not permitted */
+        keep = !fdict_enabled() || fv->dim[fv->len] != FDICT_NONE;
+        keep &= !fmask_enabled() || fmask_test(fv->dim[fv->len]);
+
         /* Signed embedding */
         if (sign)
             fv->val[fv->len] *= (signed) h > 0 ? -1 : 1;
 
         /* Cache feature */
-        if (fhash_enabled())
+        if (fhash_enabled() && keep)
             cache_put(&cache[ci], fv, fstr, flen);
 
+        /* Hand feature over to sink */
+        if (sink && keep) {
+            sink->put(sink->ctx, fv->dim[fv->len]);
+            fv->total++;
+        } else {
+            fv->len += keep;
+        }
+
         t++;
-        fv->len++;
         ci++;
         free(fstr);
     }
@@ -585,43 +700,90 @@ static void count_feat(fvec_t *fv)
 }
 
 /**
- * Shrinks the memory of a feature vector. The function reallocates
- * the memory of features and its values, such that the required space
- * is reduced to a minimum.
+ * Shrinks the memory of a feature vector if the slack of its lists
+ * exceeds a threshold. Copying the lists after every operation is more
+ * expensive than keeping a few unused entries around.
+ * @param fv Feature vector
  */
 void fvec_realloc(fvec_t *fv)
 {
-    feat_t *p_dim = NULL;
-    float *p_val = NULL;
+    unsigned long slack = fv->size - fv->len;
+
+    if (fv->len > 0 && (slack <= FVEC_SLACK || slack <= fv->len))
+        return;
+
+    fvec_shrink(fv);
+}
+
+/**
+ * Shrinks the memory of a feature vector to its length. On some
+ * platforms realloc() does not shrink memory blocks. The function
+ * thus checks the result and keeps the original lists if realloc()
+ * fails, such that no memory is lost. The unused entries are accounted
+ * for in the size of the vector in any case.
+ * @param fv Feature vector
+ */
+void fvec_shrink(fvec_t *fv)
+{
+    feat_t *p_dim;
+    float *p_val;
 
     if (fv->len <= 0) {
         fvec_truncate(fv);
         return;
     }
 
-    /*
-     * Explicit reallocation. Don't use realloc(). On some platforms
-     * realloc() will not shrink memory blocks or copy to smaller sizes.
-     * Consequently, realloc() may result in memory leaks.
-     */
-    p_dim = malloc(fv->len * sizeof(feat_t));
-    p_val = malloc(fv->len * sizeof(float));
-    if (!p_dim || !p_val) {
-        error("Could not re-allocate feature vector");
-        free(p_dim);
-        free(p_val);
+    if (fv->size == fv->len)
         return;
-    }
 
-    /* Copy to new feature vector */
-    memcpy(p_dim, fv->dim, fv->len * sizeof(feat_t));
-    memcpy(p_val, fv->val, fv->len * sizeof(float));
+    p_dim = realloc(fv->dim, fv->len * sizeof(feat_t));
+    if (p_dim)
+        fv->dim = p_dim;
 
-    /* Free old */
-    free(fv->dim);
-    free(fv->val);
-    fv->val = p_val;
+    p_val = realloc(fv->val, fv->len * sizeof(float));
+    if (p_val)
+        fv->val = p_val;
+
+    /* Size is determined by the shorter list */
+    if (p_dim || p_val)
+        fv->size = fv->len;
+}
+
+/**
+ * Reserves memory for a given number of features. The lists of the
+ * vector grow at least by a factor of two, such that repeated calls
+ * run in amortized constant time.
+ * @param fv Feature vector
+ * @param n Number of features
+ * @return 1 on success, 0 otherwise
+ */
+int fvec_reserve(fvec_t *fv, unsigned long n)
+{
+    feat_t *p_dim;
+    float *p_val;
+
+    if (n <= fv->size)
+        return TRUE;
+
+    if (n < 2 * fv->size)
+        n = 2 * fv->size;
+
+    p_dim = realloc(fv->dim, n * sizeof(feat_t));
+    if (!p_dim) {
+        error("Could not re-allocate feature vector");
+        return FALSE;
+    }
     fv->dim = p_dim;
+
+    p_val = realloc(fv->val, n * sizeof(float));
+    if (!p_val) {
+        error("Could not re-allocate feature vector");
+        return FALSE;
+    }
+    fv->val = p_val;
+
+    fv->size = n;
+    return TRUE;
 }
 
 /**
@@ -735,14 +897,16 @@ fvec_t *fvec_read(gzFile z)
         fvec_destroy(f);
         return NULL;
     }
+    f->size = f->len;
 
     /* Load features */
     for (i = 0; i < f->len; i++) {
+        unsigned long long dim;
         gzgets(z, buf, 512);
-        r = sscanf(buf, "  feat=%llx:%f\n", (unsigned long long *) &f->dim[i],
-                   (float *) &f->val[i]);
+        r = sscanf(buf, "  feat=%llx:%f\n", &dim, (float *) &f->val[i]);
         if (r != 2)
             goto err;
+        f->dim[i] = (feat_t) dim;
     }
 
     return f;
@@ -770,6 +934,328 @@ void fvec_write(fvec_t *f, gzFile z)
                  (unsigned long long) f->dim[i], (double) f->val[i]);
 }
 
+/**
+ * Parses the name of a value encoding. Only the integer encodings
+ * are recognized. All other names, including "auto", map to floats
+ * and leave the values unchanged.
+ * @param s Name of encoding
+ * @return encoding
+ */
+int fvec_enc_parse(const char *s)
+{
+    if (!strcasecmp(s, "uint16"))
+        return FVEC_ENC_UINT16;
+    if (!strcasecmp(s, "uint8"))
+        return FVEC_ENC_UINT8;
+    return FVEC_ENC_FLOAT;
+}
+
+/**
+ * Determines the most compact encoding that represents all values of a
+ * feature vector without loss. The loop is kept free of branches.
+ * @param fv Feature vector
+ * @return encoding
+ */
+int fvec_encoding(fvec_t *fv)
+{
+    unsigned long i;
+    int one = 1, u8 = 1, u16 = 1;
+
+    for (i = 0; i < fv->len; i++) {
+        float v = fv->val[i];
+        int cnt = (v >= 0) & (v == floorf(v));
+
+        one &= v == 1;
+        u8 &= cnt & (v <= UINT8_MAX);
+        u16 &= cnt & (v <= UINT16_MAX);
+    }
+
+    if (one)
+        return FVEC_ENC_ONE;
+    if (u8)
+        return FVEC_ENC_UINT8;
+    if (u16)
+        return FVEC_ENC_UINT16;
+    return FVEC_ENC_FLOAT;
+}
+
+/**
+ * Saturates the values of a feature vector to an integer encoding. The
+ * values are rounded and clamped to the range of the encoding, such that
+ * large counts are kept at the maximum. Dimensions with values rounded
+ * to zero are removed.
+ * @param fv Feature vector
+ * @param enc Encoding
+ */
+void fvec_saturate(fvec_t *fv, int enc)
+{
+    unsigned long i, j;
+    float max;
+
+    if (enc == FVEC_ENC_UINT8)
+        max = UINT8_MAX;
+    else if (enc == FVEC_ENC_UINT16)
+        max = UINT16_MAX;
+    else
+        return;
+
+    for (i = 0, j = 0; i < fv->len; i++) {
+        float v = fminf(fmaxf(rintf(fv->val[i]), 0), max);
+        fv->dim[j] = fv->dim[i];
+        fv->val[j] = v;
+        j += v > 0;
+    }
+
+    fv->len = j;
+}
+
+/**
+ * Writes values of a feature vector in a given encoding. Integer
+ * encodings are converted in chunks on the stack.
+ * @param val Array of values
+ * @param len Length of array
+ * @param enc Encoding
+ * @param z File pointer
+ * @return 1 on success, 0 otherwise
+ */
+static int write_vals(float *val, unsigned long len, int enc, gzFile z)
+{
+    uint16_t buf[FVEC_BIN_CHUNK];
+    uint8_t *buf8 = (uint8_t *) buf;
+    unsigned long i, j, n, size;
+
+    if (enc == FVEC_ENC_ONE)
+        return TRUE;
+    if (enc == FVEC_ENC_FLOAT)
+        return gzwrite(z, val, len * sizeof(float)) == len * sizeof(float);
+
+    for (i = 0; i < len; i += n) {
+        n = len - i < FVEC_BIN_CHUNK ? len - i : FVEC_BIN_CHUNK;
+        if (enc == FVEC_ENC_UINT8) {
+            for (j = 0; j < n; j++)
+                buf8[j] = (uint8_t) val[i + j];
+            size = n * sizeof(uint8_t);
+        } else {
+            for (j = 0; j < n; j++)
+                buf[j] = (uint16_t) val[i + j];
+            size = n * sizeof(uint16_t);
+        }
+        if (gzwrite(z, buf, size) != size)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Reads values of a feature vector in a given encoding.
+ * @param val Array of values
+ * @param len Length of array
+ * @param enc Encoding
+ * @param z File pointer
+ * @return 1 on success, 0 otherwise
+ */
+static int read_vals(float *val, unsigned long len, int enc, gzFile z)
+{
+    uint16_t buf[FVEC_BIN_CHUNK];
+    uint8_t *buf8 = (uint8_t *) buf;
+    unsigned long i, j, n, size;
+
+    switch (enc) {
+    case FVEC_ENC_ONE:
+        for (i = 0; i < len; i++)
+            val[i] = 1;
+        return TRUE;
+    case FVEC_ENC_FLOAT:
+        return gzread(z, val, len * sizeof(float)) == len * sizeof(float);
+    case FVEC_ENC_UINT8:
+    case FVEC_ENC_UINT16:
+        break;
+    default:
+        return FALSE;
+    }
+
+    for (i = 0; i < len; i += n) {
+        n = len - i < FVEC_BIN_CHUNK ? len - i : FVEC_BIN_CHUNK;
+        size = n * (enc == FVEC_ENC_UINT8 ? sizeof(uint8_t) :
+                    sizeof(uint16_t));
+        if (gzread(z, buf, size) != size)
+            return FALSE;
+        if (enc == FVEC_ENC_UINT8)
+            for (j = 0; j < n; j++)
+                val[i + j] = buf8[j];
+        else
+            for (j = 0; j < n; j++)
+                val[i + j] = buf[j];
+    }
+
+    return TRUE;
+}
+
+/**
+ * Writes dimensions of a feature vector with 64 bits each. Narrow
+ * dimensions are converted in chunks on the stack.
+ * @param dim Array of dimensions
+ * @param len Length of array
+ * @param z File pointer
+ * @return 1 on success, 0 otherwise
+ */
+static int write_dims(feat_t *dim, unsigned long len, gzFile z)
+{
+    uint64_t buf[FVEC_BIN_CHUNK];
+    unsigned long i, j, n;
+
+    if (sizeof(feat_t) == sizeof(uint64_t))
+        return gzwrite(z, dim, len * sizeof(uint64_t)) ==
+            len * sizeof(uint64_t);
+
+    for (i = 0; i < len; i += n) {
+        n = len - i < FVEC_BIN_CHUNK ? len - i : FVEC_BIN_CHUNK;
+        for (j = 0; j < n; j++)
+            buf[j] = dim[i + j];
+        if (gzwrite(z, buf, n * sizeof(uint64_t)) != n * sizeof(uint64_t))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Reads dimensions of a feature vector stored with 64 bits each.
+ * Dimensions that do not fit into a feature are rejected.
+ * @param dim Array of dimensions
+ * @param len Length of array
+ * @param z File pointer
+ * @return 1 on success, 0 otherwise
+ */
+static int read_dims(feat_t *dim, unsigned long len, gzFile z)
+{
+    uint64_t buf[FVEC_BIN_CHUNK];
+    unsigned long i, j, n;
+
+    if (sizeof(feat_t) == sizeof(uint64_t))
+        return gzread(z, dim, len * sizeof(uint64_t)) ==
+            len * sizeof(uint64_t);
+
+    for (i = 0; i < len; i += n) {
+        n = len - i < FVEC_BIN_CHUNK ? len - i : FVEC_BIN_CHUNK;
+        if (gzread(z, buf, n * sizeof(uint64_t)) != n * sizeof(uint64_t))
+            return FALSE;
+        for (j = 0; j < n; j++) {
+            if (buf[j] > FEAT_MAX)
+                return FALSE;
+            dim[i + j] = (feat_t) buf[j];
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * Writes a feature vector in binary format to a file stream. The
+ * format is compact but not portable across platforms. It is intended
+ * for temporary files and data exchanged between runs of Sally. The
+ * dimensions are always stored with 64 bits, such that builds with
+ * narrow and wide dimensions can read each other's files. The values
+ * are stored in the most compact encoding that is lossless for
+ * the vector, that is, binary vectors need no values at all and counts
+ * are stored with 8 or 16 bits.
+ * @param f Feature vector
+ * @param z File pointer
+ * @return 1 on success, 0 otherwise
+ */
+int fvec_write_bin(fvec_t *f, gzFile z)
+{
+    assert(f && z);
+    uint64_t len = f->len, total = f->total;
+    uint32_t slen = f->src ? strlen(f->src) : 0;
+    uint8_t enc;
+    int r = 0;
+
+    r += gzwrite(z, &len, sizeof(len)) == sizeof(len);
+    r += gzwrite(z, &total, sizeof(total)) == sizeof(total);
+    r += gzwrite(z, &f->label, sizeof(float)) == sizeof(float);
+    r += gzwrite(z, &slen, sizeof(slen)) == sizeof(slen);
+    if (r != 4)
+        return FALSE;
+
+    if (slen > 0 && gzwrite(z, f->src, slen) != slen)
+        return FALSE;
+    if (len == 0)
+        return TRUE;
+
+    enc = fvec_encoding(f);
+    if (gzwrite(z, &enc, sizeof(enc)) != sizeof(enc))
+        return FALSE;
+    if (!write_dims(f->dim, len, z))
+        return FALSE;
+
+    return write_vals(f->val, len, enc, z);
+}
+
+/**
+ * Reads a feature vector in binary format from a file stream.
+ * @param z File pointer
+ * @return Feature vector or NULL at the end of the stream
+ */
+fvec_t *fvec_read_bin(gzFile z)
+{
+    assert(z);
+    uint64_t len, total;
+    uint32_t slen;
+    uint8_t enc;
+    fvec_t *f;
+
+    /* Check for end of stream */
+    if (gzread(z, &len, sizeof(len)) != sizeof(len))
+        return NULL;
+
+    /* Allocate feature vector (zero'd) */
+    f = calloc(1, sizeof(fvec_t));
+    if (!f) {
+        error("Could not load feature vector");
+        return NULL;
+    }
+
+    if (gzread(z, &total, sizeof(total)) != sizeof(total) ||
+        gzread(z, &f->label, sizeof(float)) != sizeof(float) ||
+        gzread(z, &slen, sizeof(slen)) != sizeof(slen))
+        goto err;
+
+    f->len = len;
+    f->total = total;
+
+    /* Set source */
+    if (slen > 0) {
+        f->src = malloc(slen + 1);
+        if (!f->src || gzread(z, f->src, slen) != slen)
+            goto err;
+        f->src[slen] = 0;
+    }
+
+    /* Empty feature vector */
+    if (f->len == 0)
+        return f;
+
+    /* Allocate arrays */
+    f->dim = (feat_t *) malloc(f->len * sizeof(feat_t));
+    f->val = (float *) malloc(f->len * sizeof(float));
+    if (!f->dim || !f->val)
+        goto err;
+    f->size = f->len;
+
+    if (gzread(z, &enc, sizeof(enc)) != sizeof(enc) ||
+        !read_dims(f->dim, len, z) ||
+        !read_vals(f->val, len, enc, z))
+        goto err;
+
+    return f;
+  err:
+    error("Failed to read binary feature vector");
+    fvec_destroy(f);
+    return NULL;
+}
+
 /**
  * Loads a feature vector from a file 
  * @param f File name
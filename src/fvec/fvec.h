@@ -16,7 +16,15 @@
 #include <stdint.h>
 
 /** Data type for a feature */
+#ifdef ENABLE_NARROW_DIMS
+typedef uint32_t feat_t;
+#define FEAT_MAX        UINT32_MAX
+#define FEAT_BITS       32
+#else
 typedef uint64_t feat_t;
+#define FEAT_MAX        UINT64_MAX
+#define FEAT_BITS       64
+#endif
 
 /** Placeholder for non-initialized delimiters */
 #define DELIM_NOT_INIT	42
@@ -24,6 +32,18 @@ typedef uint64_t feat_t;
 /** Zero value in each feature */
 #define FVEC_ZERO	1e-9
 
+/** Slack of lists tolerated before shrinking memory */
+#define FVEC_SLACK	64
+
+/** Number of entries converted at once in binary format */
+#define FVEC_BIN_CHUNK	1024
+
+/** Encodings of values in binary format */
+#define FVEC_ENC_FLOAT	0       /* 32-bit floats */
+#define FVEC_ENC_UINT16	1       /* 16-bit counts */
+#define FVEC_ENC_UINT8	2       /* 8-bit counts */
+#define FVEC_ENC_ONE	3       /* Implicit binary values */
+
 /**
  * Sparse feature vector. The vector is stored as a sorted list 
  * of non-zero dimensions containing real numbers. The dimensions
@@ -35,6 +55,7 @@ typedef struct
     feat_t *dim;            /**< List of dimensions */
     float *val;             /**< List of values */
     unsigned long len;      /**< Length of list */
+    unsigned long size;     /**< Allocated length of list */
     unsigned long total;    /**< Total features in string */
     float label;            /**< Label of features */
     char *src;              /**< Source of features */
@@ -50,20 +71,40 @@ typedef struct
     int l;                  /**< Length of token */
 } token_t;
 
+/**
+ * Sink for the features of a string. The features are handed over one
+ * by one instead of being stored in a feature vector.
+ */
+typedef struct
+{
+    void (*put) (void *, feat_t);   /**< Callback for each feature */
+    void *ctx;              /**< Context of callback */
+} fsink_t;
+
 /* Functions */
 fvec_t *fvec_extract(char *, int l);
 void fvec_destroy(fvec_t *);
 void fvec_print(FILE *, fvec_t *);
 void fvec_realloc(fvec_t *);
+void fvec_shrink(fvec_t *);
+int fvec_reserve(fvec_t *, unsigned long);
 void fvec_set_label(fvec_t *fv, float l);
 void fvec_set_source(fvec_t *fv, char *s);
 void fvec_write(fvec_t *f, gzFile);
 fvec_t *fvec_zero();
 void fvec_truncate(fvec_t *const fv);
 fvec_t *fvec_read(gzFile);
+int fvec_write_bin(fvec_t *f, gzFile);
+fvec_t *fvec_read_bin(gzFile);
+int fvec_encoding(fvec_t *fv);
+int fvec_enc_parse(const char *s);
+void fvec_saturate(fvec_t *fv, int enc);
 void fvec_save(fvec_t *fv, char *f);
 fvec_t *fvec_load(char *);
 fvec_t *fvec_extract_intern(char *x, int l);
+fvec_t *fvec_extract_intern2(char *x, int l, int n);
+unsigned long fvec_extract_sink(char *x, int l, fsink_t *sink);
+void fvec_postprocess(fvec_t *fv);
 
 /* Delimiter functions */
 void fvec_delim_set(const char *s);
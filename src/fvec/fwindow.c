@@ -0,0 +1,316 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+/**
+ * @addtogroup fvec Feature vector
+ * <hr>
+ * Incremental embedding of sliding windows. A window of a fixed number
+ * of bytes or tokens is moved over a string and one vector is emitted
+ * per stride. The counts of the n-grams inside the window are kept in
+ * a table and updated incrementally: only the n-grams entering and
+ * leaving the window are extracted, such that the cost of an update
+ * depends on the stride and not on the length of the window.
+ * @author Konrad Rieck (konrad@mlsec.org)
+ * @{
+ */
+
+#include "config.h"
+#include "common.h"
+#include "fvec.h"
+#include "fhash.h"
+#include "fwindow.h"
+#include "util.h"
+
+/**
+ * Count of a feature inside the window
+ */
+typedef struct
+{
+    feat_t dim;             /**< Feature */
+    float val;              /**< Summed value */
+    UT_hash_handle hh;      /**< Uthash handle */
+} wcount_t;
+
+/**
+ * State of a sliding window
+ */
+typedef struct
+{
+    wcount_t *table;        /**< Counts of features */
+    unsigned long len;      /**< Number of features in table */
+    long total;             /**< Number of n-grams in window */
+    int nlen;               /**< N-gram length counted in total */
+    char *x;                /**< String */
+    int *start;             /**< Start offsets of units */
+    int *end;               /**< End offsets of units */
+} window_t;
+
+/* External variables */
+extern config_t cfg;
+extern char delim[256];
+
+/* Window configuration */
+static int enabled = FALSE;
+static long win_len = 0;
+static long win_stride = 0;
+
+/**
+ * Enables the embedding of sliding windows if a window length is set
+ */
+void fwindow_init()
+{
+    cfg_int len, stride;
+
+    config_lookup_int(&cfg, "features.window_len", &len);
+    config_lookup_int(&cfg, "features.window_stride", &stride);
+
+    win_len = len;
+    win_stride = stride > 0 ? stride : len;
+    enabled = win_len > 0;
+}
+
+/**
+ * Checks whether sliding windows are enabled
+ * @return 1 if enabled, 0 otherwise
+ */
+int fwindow_enabled()
+{
+    return enabled;
+}
+
+/**
+ * Splits a string into units of the window. A unit is either a byte or
+ * a token, that is, a maximal run of non-delimiter bytes.
+ * @param w Window state
+ * @param l Length of string
+ * @param tokens Use tokens as units
+ * @return number of units
+ */
+static long window_units(window_t *w, int l, int tokens)
+{
+    long i, n = 0;
+
+    w->start = malloc((l + 1) * sizeof(int));
+    w->end = malloc((l + 1) * sizeof(int));
+    if (!w->start || !w->end) {
+        error("Could not allocate units of window");
+        return -1;
+    }
+
+    for (i = 0; i < l; i++) {
+        if (!tokens) {
+            w->start[n] = i;
+            w->end[n++] = i + 1;
+        } else if (!delim[(unsigned char) w->x[i]]) {
+            if (i == 0 || delim[(unsigned char) w->x[i - 1]])
+                w->start[n] = i;
+            if (i == l - 1 || delim[(unsigned char) w->x[i + 1]])
+                w->end[n++] = i + 1;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * Adds or removes the n-grams starting at a range of units. The
+ * n-grams are extracted from the substring covering the range and the
+ * following n - 1 units.
+ * @param w Window state
+ * @param p First unit
+ * @param q Unit after the last
+ * @param n N-gram length
+ * @param sign +1 to add, -1 to remove
+ */
+static void window_update(window_t *w, long p, long q, int n, int sign)
+{
+    unsigned long i;
+    wcount_t *c;
+    fvec_t *fv;
+
+    if (p >= q)
+        return;
+
+    fv = fvec_extract_intern2(w->x + w->start[p],
+                              w->end[q + n - 2] - w->start[p], n);
+    if (!fv)
+        return;
+
+    for (i = 0; i < fv->len; i++) {
+        HASH_FIND(hh, w->table, &fv->dim[i], sizeof(feat_t), c);
+        if (!c) {
+            c = calloc(1, sizeof(wcount_t));
+            if (!c) {
+                error("Could not allocate counts of window");
+                break;
+            }
+            c->dim = fv->dim[i];
+            HASH_ADD(hh, w->table, dim, sizeof(feat_t), c);
+            w->len++;
+        }
+
+        /* Drop features that left the window */
+        c->val += sign * fv->val[i];
+        if (fabs(c->val) < FVEC_ZERO) {
+            HASH_DEL(w->table, c);
+            free(c);
+            w->len--;
+        }
+    }
+
+    /* Blended n-grams do not add to the total as in fvec_add() */
+    if (n == w->nlen)
+        w->total += sign * (long) fv->total;
+    fvec_destroy(fv);
+}
+
+/**
+ * Compares two counts by feature (for qsort)
+ * @param x Count
+ * @param y Count
+ * @return comparison
+ */
+static int cmp_dim(const void *x, const void *y)
+{
+    const wcount_t *a = *(wcount_t **) x, *b = *(wcount_t **) y;
+    return (a->dim > b->dim) - (a->dim < b->dim);
+}
+
+/**
+ * Creates a feature vector from the counts of the window
+ * @param w Window state
+ * @return feature vector
+ */
+static fvec_t *window_vector(window_t *w)
+{
+    unsigned long i;
+    wcount_t **counts, *c;
+    fvec_t *fv;
+
+    fv = calloc(1, sizeof(fvec_t));
+    counts = malloc((w->len + 1) * sizeof(wcount_t *));
+    if (!fv || !counts || !fvec_reserve(fv, w->len)) {
+        error("Could not allocate vector of window");
+        fvec_destroy(fv);
+        free(counts);
+        return NULL;
+    }
+
+    for (i = 0, c = w->table; c; c = c->hh.next)
+        counts[i++] = c;
+    qsort(counts, w->len, sizeof(wcount_t *), cmp_dim);
+
+    for (i = 0; i < w->len; i++) {
+        fv->dim[i] = counts[i]->dim;
+        fv->val[i] = counts[i]->val;
+    }
+    fv->len = w->len;
+    fv->total = w->total;
+
+    free(counts);
+    return fv;
+}
+
+/**
+ * Extracts feature vectors from sliding windows over a string. One
+ * vector is emitted per stride for each complete window. Strings
+ * shorter than the window yield a single vector. The vectors are not
+ * post-processed.
+ * @param x String of bytes
+ * @param l Length of string
+ * @param num Number of extracted vectors
+ * @return array of feature vectors
+ */
+fvec_t **fwindow_extract(char *x, int l, long *num)
+{
+    long i, k, m, s, units, *a = NULL, *b = NULL, na, nb;
+    int blend, n, lo, tokens;
+    const char *granu;
+    cfg_int nlen;
+    fvec_t **fv = NULL;
+    window_t w;
+    wcount_t *c;
+
+    config_lookup_string(&cfg, "features.granularity", &granu);
+    config_lookup_bool(&cfg, "features.ngram_blend", &blend);
+    config_lookup_int(&cfg, "features.ngram_len", &nlen);
+    tokens = !strcasecmp(granu, "tokens");
+
+    *num = 0;
+    memset(&w, 0, sizeof(window_t));
+    w.x = x;
+    w.nlen = nlen;
+
+    units = window_units(&w, l, tokens);
+    if (units < 0)
+        goto out;
+
+    /* Short strings are embedded as a whole */
+    if (units < win_len) {
+        fv = malloc(sizeof(fvec_t *));
+        if (fv && (fv[0] = fvec_extract_intern(x, l)))
+            *num = 1;
+        goto out;
+    }
+
+    /* Ranges of n-grams inside the window for each length */
+    lo = blend ? 1 : nlen;
+    a = calloc(nlen - lo + 1, sizeof(long));
+    b = calloc(nlen - lo + 1, sizeof(long));
+
+    m = (units - win_len) / win_stride + 1;
+    fv = malloc(m * sizeof(fvec_t *));
+    if (!fv || !a || !b) {
+        error("Could not allocate vectors of windows");
+        goto out;
+    }
+
+    for (k = 0; k < m; k++) {
+        s = k * win_stride;
+
+        /* Remove leaving and add entering n-grams */
+        for (n = lo; n <= nlen; n++) {
+            i = n - lo;
+            na = s;
+            nb = s + win_len - n + 1;
+            if (nb < na)
+                nb = na;
+
+            window_update(&w, a[i], na < b[i] ? na : b[i], n, -1);
+            window_update(&w, na > b[i] ? na : b[i], nb, n, +1);
+            a[i] = na, b[i] = nb;
+        }
+
+        fv[k] = window_vector(&w);
+        if (!fv[k])
+            break;
+    }
+    *num = k;
+
+  out:
+    while (w.table) {
+        c = w.table;
+        HASH_DEL(w.table, c);
+        free(c);
+    }
+    free(w.start);
+    free(w.end);
+    free(a);
+    free(b);
+
+    if (*num == 0) {
+        free(fv);
+        return NULL;
+    }
+    return fv;
+}
+
+/** @} */
@@ -0,0 +1,21 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+#ifndef FWINDOW_H
+#define FWINDOW_H
+
+#include "fvec.h"
+
+void fwindow_init();
+int fwindow_enabled();
+fvec_t **fwindow_extract(char *x, int l, long *num);
+
+#endif /* FWINDOW_H */
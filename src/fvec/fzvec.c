@@ -0,0 +1,395 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+/**
+ * @addtogroup fvec Feature vector
+ * <hr>
+ * Compressed feature vectors. The dimensions of a feature vector are
+ * sorted, such that the differences between neighboring dimensions are
+ * small and can be stored in one to three bytes for most vectors
+ * instead of eight. The dot product and the addition operate on the
+ * encoded dimensions directly without expanding them.
+ * @author Konrad Rieck (konrad@mlsec.org)
+ * @{
+ */
+
+#include "config.h"
+#include "common.h"
+#include "fvec.h"
+#include "fzvec.h"
+#include "util.h"
+
+/**
+ * Decodes a variable-length integer
+ * @param p Pointer to encoded bytes
+ * @param x Decoded integer
+ * @return pointer to next encoded integer
+ */
+static inline uint8_t *varint_get(uint8_t *p, feat_t *x)
+{
+    feat_t v = 0;
+    int s = 0;
+
+    while (*p & 0x80) {
+        v |= (feat_t) (*p++ & 0x7f) << s;
+        s += 7;
+    }
+    *x = v | (feat_t) *p++ << s;
+    return p;
+}
+
+/**
+ * Encodes a variable-length integer
+ * @param p Pointer to buffer
+ * @param x Integer
+ * @return pointer to end of encoded integer
+ */
+static inline uint8_t *varint_put(uint8_t *p, feat_t x)
+{
+    while (x >= 0x80) {
+        *p++ = (uint8_t) (x | 0x80);
+        x >>= 7;
+    }
+    *p++ = (uint8_t) x;
+    return p;
+}
+
+/**
+ * Encodes sorted dimensions. The buffer needs to provide space for
+ * FZVEC_MAX_BYTES bytes per dimension.
+ * @param buf Buffer for encoded dimensions
+ * @param dim Sorted dimensions
+ * @param len Number of dimensions
+ * @return number of bytes written
+ */
+unsigned long fzvec_encode(uint8_t *buf, feat_t *dim, unsigned long len)
+{
+    unsigned long i;
+    uint8_t *p = buf;
+
+    for (i = 0; i < len; i++)
+        p = varint_put(p, dim[i] - (i > 0 ? dim[i - 1] : 0));
+
+    return p - buf;
+}
+
+/**
+ * Decodes sorted dimensions.
+ * @param dim Array for dimensions
+ * @param buf Encoded dimensions
+ * @param len Number of dimensions
+ */
+void fzvec_decode(feat_t *dim, uint8_t *buf, unsigned long len)
+{
+    unsigned long i;
+    feat_t d = 0, x;
+
+    for (i = 0; i < len; i++) {
+        buf = varint_get(buf, &x);
+        dim[i] = d += x;
+    }
+}
+
+/**
+ * Compresses a feature vector. Label and source are not retained.
+ * @param fv Feature vector
+ * @return compressed feature vector
+ */
+fzvec_t *fzvec_compress(fvec_t *fv)
+{
+    uint8_t *p;
+    fzvec_t *zv = calloc(1, sizeof(fzvec_t));
+    if (!zv) {
+        error("Could not allocate compressed feature vector");
+        return NULL;
+    }
+
+    zv->len = fv->len;
+    zv->dim = malloc(fv->len * FZVEC_MAX_BYTES + 1);
+    zv->val = malloc(fv->len * sizeof(float) + 1);
+    if (!zv->dim || !zv->val) {
+        error("Could not allocate compressed feature vector");
+        fzvec_destroy(zv);
+        return NULL;
+    }
+
+    zv->bytes = fzvec_encode(zv->dim, fv->dim, fv->len);
+    memcpy(zv->val, fv->val, fv->len * sizeof(float));
+
+    /* Shrink encoded dimensions */
+    p = realloc(zv->dim, zv->bytes + 1);
+    if (p)
+        zv->dim = p;
+
+    return zv;
+}
+
+/**
+ * Expands a compressed feature vector.
+ * @param zv Compressed feature vector
+ * @return feature vector
+ */
+fvec_t *fzvec_expand(fzvec_t *zv)
+{
+    fvec_t *fv = fvec_zero();
+    if (!fv)
+        return NULL;
+
+    if (!fvec_reserve(fv, zv->len)) {
+        error("Could not allocate feature vector contents");
+        fvec_destroy(fv);
+        return NULL;
+    }
+
+    fzvec_decode(fv->dim, zv->dim, zv->len);
+    memcpy(fv->val, zv->val, zv->len * sizeof(float));
+    fv->len = zv->len;
+
+    return fv;
+}
+
+/**
+ * Destroys a compressed feature vector
+ * @param zv Compressed feature vector
+ */
+void fzvec_destroy(fzvec_t *zv)
+{
+    if (!zv)
+        return;
+
+    free(zv->dim);
+    free(zv->val);
+    free(zv);
+}
+
+/**
+ * Dot product between a compressed and a regular feature vector. The
+ * dimensions of a are decoded on the fly while merging with b.
+ * @param za Compressed feature vector (a)
+ * @param fb Feature vector (b)
+ * @return dot product
+ */
+double fzvec_dot(fzvec_t *za, fvec_t *fb)
+{
+    unsigned long i = 0, j = 0;
+    uint8_t *p = za->dim;
+    feat_t d, x;
+    double s = 0;
+
+    if (za->len == 0 || fb->len == 0)
+        return 0;
+
+    p = varint_get(p, &d);
+    while (j < fb->len) {
+        if (d > fb->dim[j]) {
+            j++;
+            continue;
+        }
+        if (d == fb->dim[j])
+            s += za->val[i] * fb->val[j++];
+        if (++i == za->len)
+            break;
+        p = varint_get(p, &x);
+        d += x;
+    }
+
+    return s;
+}
+
+/**
+ * Adds a compressed feature vector to a regular one (a = a + b). The
+ * entries of a are moved to the end of its arrays first, such that
+ * both vectors can be merged in place from the front.
+ * @param fa Feature vector (a)
+ * @param zb Compressed feature vector (b)
+ */
+void fzvec_add(fvec_t *fa, fzvec_t *zb)
+{
+    unsigned long i, j = 0, k = 0, n;
+    uint8_t *p = zb->dim;
+    feat_t d = 0, x;
+
+    if (zb->len == 0)
+        return;
+
+    /* Grow arrays and move entries of a to the end */
+    if (!fvec_reserve(fa, fa->len + zb->len)) {
+        error("Could not allocate feature vector contents");
+        return;
+    }
+    memmove(fa->dim + zb->len, fa->dim, fa->len * sizeof(feat_t));
+    memmove(fa->val + zb->len, fa->val, fa->len * sizeof(float));
+
+    i = zb->len, n = zb->len + fa->len;
+    p = varint_get(p, &x);
+    d = x;
+
+    while (i < n && j < zb->len) {
+        if (fa->dim[i] < d) {
+            fa->dim[k] = fa->dim[i];
+            fa->val[k++] = fa->val[i++];
+            continue;
+        }
+        if (fa->dim[i] == d) {
+            fa->dim[k] = d;
+            fa->val[k++] = (float) (fa->val[i++] + zb->val[j]);
+        } else {
+            fa->dim[k] = d;
+            fa->val[k++] = zb->val[j];
+        }
+        if (++j < zb->len) {
+            p = varint_get(p, &x);
+            d += x;
+        }
+    }
+
+    /* Copy remaining entries */
+    while (j < zb->len) {
+        fa->dim[k] = d;
+        fa->val[k++] = zb->val[j];
+        if (++j < zb->len) {
+            p = varint_get(p, &x);
+            d += x;
+        }
+    }
+    while (i < n) {
+        fa->dim[k] = fa->dim[i];
+        fa->val[k++] = fa->val[i++];
+    }
+
+    fa->len = k;
+    fvec_realloc(fa);
+}
+
+/**
+ * Creates an empty set of compressed feature vectors.
+ * @return set of compressed vectors
+ */
+fzset_t *fzset_create()
+{
+    fzset_t *zs = calloc(1, sizeof(fzset_t));
+    if (!zs) {
+        error("Could not allocate set of compressed vectors");
+        return NULL;
+    }
+
+    zs->off = calloc(1, sizeof(unsigned long));
+    zs->pos = calloc(1, sizeof(unsigned long));
+    if (!zs->off || !zs->pos) {
+        error("Could not allocate set of compressed vectors");
+        fzset_destroy(zs);
+        return NULL;
+    }
+    zs->num_size = 1;
+
+    return zs;
+}
+
+/**
+ * Adds a feature vector to a set of compressed vectors. The memory of
+ * the set grows by doubling.
+ * @param zs Set of compressed vectors
+ * @param fv Feature vector
+ * @return 1 on success, 0 otherwise
+ */
+int fzset_add(fzset_t *zs, fvec_t *fv)
+{
+    unsigned long bytes = zs->off[zs->num], nnz = zs->pos[zs->num];
+    unsigned long s;
+    void *p;
+
+    if (zs->num + 2 > zs->num_size) {
+        s = 2 * zs->num_size;
+        if (!(p = realloc(zs->off, s * sizeof(unsigned long))))
+            goto err;
+        zs->off = p;
+        if (!(p = realloc(zs->pos, s * sizeof(unsigned long))))
+            goto err;
+        zs->pos = p;
+        zs->num_size = s;
+    }
+
+    if (bytes + fv->len * FZVEC_MAX_BYTES > zs->dim_size) {
+        s = 2 * zs->dim_size + fv->len * FZVEC_MAX_BYTES;
+        if (!(p = realloc(zs->dim, s)))
+            goto err;
+        zs->dim = p;
+        zs->dim_size = s;
+    }
+
+    if (nnz + fv->len > zs->val_size) {
+        s = 2 * zs->val_size + fv->len;
+        if (!(p = realloc(zs->val, s * sizeof(float))))
+            goto err;
+        zs->val = p;
+        zs->val_size = s;
+    }
+
+    bytes += fzvec_encode(zs->dim + bytes, fv->dim, fv->len);
+    memcpy(zs->val + nnz, fv->val, fv->len * sizeof(float));
+
+    zs->num++;
+    zs->off[zs->num] = bytes;
+    zs->pos[zs->num] = nnz + fv->len;
+    if (fv->len > zs->max)
+        zs->max = fv->len;
+
+    return TRUE;
+
+  err:
+    error("Could not allocate set of compressed vectors");
+    return FALSE;
+}
+
+/**
+ * Provides a view of a vector in a set of compressed vectors. The view
+ * points to the memory of the set and must not be destroyed.
+ * @param zs Set of compressed vectors
+ * @param i Index of vector
+ * @param zv Compressed vector to fill
+ */
+void fzset_get(fzset_t *zs, unsigned long i, fzvec_t *zv)
+{
+    assert(i < zs->num);
+
+    zv->dim = zs->dim + zs->off[i];
+    zv->val = zs->val + zs->pos[i];
+    zv->len = zs->pos[i + 1] - zs->pos[i];
+    zv->bytes = zs->off[i + 1] - zs->off[i];
+}
+
+/**
+ * Returns the number of entries of all vectors in a set.
+ * @param zs Set of compressed vectors
+ * @return number of entries
+ */
+unsigned long fzset_nnz(fzset_t *zs)
+{
+    return zs->pos[zs->num];
+}
+
+/**
+ * Destroys a set of compressed feature vectors.
+ * @param zs Set of compressed vectors
+ */
+void fzset_destroy(fzset_t *zs)
+{
+    if (!zs)
+        return;
+
+    free(zs->dim);
+    free(zs->val);
+    free(zs->off);
+    free(zs->pos);
+    free(zs);
+}
+
+/** @} */
@@ -0,0 +1,68 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+#ifndef FZVEC_H
+#define FZVEC_H
+
+#include "fvec.h"
+
+/** Maximum number of bytes of an encoded dimension */
+#define FZVEC_MAX_BYTES     ((FEAT_BITS + 6) / 7)
+
+/**
+ * Compressed feature vector. The sorted dimensions are stored as
+ * differences to their predecessors, where each difference is encoded
+ * as a variable-length integer with 7 bits per byte. The values are
+ * kept as floats.
+ */
+typedef struct
+{
+    uint8_t *dim;           /**< Encoded dimensions */
+    float *val;             /**< List of values */
+    unsigned long len;      /**< Length of list */
+    unsigned long bytes;    /**< Size of encoded dimensions */
+} fzvec_t;
+
+/**
+ * Set of compressed feature vectors sharing a common memory. The
+ * dimensions of vector i start at byte off[i] and its values at
+ * position pos[i].
+ */
+typedef struct
+{
+    uint8_t *dim;           /**< Encoded dimensions of all vectors */
+    float *val;             /**< Values of all vectors */
+    unsigned long *off;     /**< Start of dimensions (num + 1 elements) */
+    unsigned long *pos;     /**< Start of values (num + 1 elements) */
+    unsigned long num;      /**< Number of vectors */
+    unsigned long max;      /**< Maximum length of vectors */
+    unsigned long num_size; /**< Allocated number of vectors */
+    unsigned long dim_size; /**< Allocated size of dimensions */
+    unsigned long val_size; /**< Allocated number of values */
+} fzset_t;
+
+/* Functions */
+unsigned long fzvec_encode(uint8_t *buf, feat_t *dim, unsigned long len);
+void fzvec_decode(feat_t *dim, uint8_t *buf, unsigned long len);
+fzvec_t *fzvec_compress(fvec_t *fv);
+fvec_t *fzvec_expand(fzvec_t *zv);
+void fzvec_destroy(fzvec_t *zv);
+double fzvec_dot(fzvec_t *za, fvec_t *fb);
+void fzvec_add(fvec_t *fa, fzvec_t *zb);
+
+/* Set functions */
+fzset_t *fzset_create();
+int fzset_add(fzset_t *zs, fvec_t *fv);
+void fzset_get(fzset_t *zs, unsigned long i, fzvec_t *zv);
+unsigned long fzset_nnz(fzset_t *zs);
+void fzset_destroy(fzset_t *zs);
+
+#endif /* FZVEC_H */
@@ -14,6 +14,11 @@
 
 #include "fvec.h"
 
+/** Normalization modes */
+#define NORM_NONE       0
+#define NORM_L1         1
+#define NORM_L2         2
+
 void fvec_norm(fvec_t *fv, const char *);
 
 #endif /* NORM_H */
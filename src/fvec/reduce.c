@@ -23,10 +23,80 @@
 #include "fvec.h"
 #include "util.h"
 #include "reduce.h"
+#include "fmath.h"
+#include "fhash.h"
+#include "vocab.h"
+#include "fselect.h"
+#include "fwindow.h"
+#include "fpca.h"
 
 /* External variables */
 extern config_t cfg;
 
+/**
+ * Replaces the contents of a feature vector with a bit signature. Only
+ * the set bits are stored as dimensions with value 1, such that the
+ * vector is sparse without further processing.
+ * @param fv Feature vector
+ * @param bits Packed bits of signature
+ * @param num Number of bits
+ */
+static void reduce_unpack(fvec_t *fv, const uint64_t *bits, int num)
+{
+    feat_t *dim;
+    float *val;
+    int i, j, len = 0;
+
+    for (i = 0; i < num; i++)
+        len += BITS_GET(bits, i);
+
+    dim = (feat_t *) malloc(len * sizeof(feat_t) + 1);
+    val = (float *) malloc(len * sizeof(float) + 1);
+
+    if (!dim || !val) {
+        error("Could not allocate feature vector contents");
+        free(dim);
+        free(val);
+        return;
+    }
+
+    for (i = 0, j = 0; i < num; i++) {
+        if (!BITS_GET(bits, i))
+            continue;
+        dim[j] = i;
+        val[j++] = 1;
+    }
+
+    /* Exchange data */
+    free(fv->dim);
+    free(fv->val);
+
+    fv->dim = dim;
+    fv->val = val;
+    fv->len = len;
+    fv->size = len;
+}
+
+/**
+ * Packs the dimensions of a reduced feature vector into a bit
+ * signature of fixed width. Non-zero dimensions below the given number
+ * of bits are set in the signature.
+ * @param fv Feature vector
+ * @param buf Buffer of ceil(num / 8) bytes
+ * @param num Number of bits
+ */
+void reduce_pack(fvec_t *fv, uint8_t *buf, int num)
+{
+    int i;
+
+    memset(buf, 0, (num + 7) / 8);
+    for (i = 0; i < fv->len; i++) {
+        if (fv->dim[i] >= (feat_t) num || fv->val[i] == 0)
+            continue;
+        buf[fv->dim[i] / 8] |= 1 << (fv->dim[i] % 8);
+    }
+}
+
 
 /**
  * Dimension reduction wrapper.
@@ -49,6 +119,10 @@ void dim_reduce(fvec_t *fv)
         reduce_minhash(fv, dim_num);
     } else if (!strcasecmp(method, "bloom")) {
         reduce_bloom(fv, dim_num);
+    } else if (!strcasecmp(method, "randproj")) {
+        reduce_randproj(fv, dim_num);
+    } else if (!strcasecmp(method, "pca")) {
+        fpca_project(fv);
     } else {
         warning("Unknown dimension reduction method. Skipping.");
     }
@@ -57,6 +131,101 @@ void dim_reduce(fvec_t *fv)
     fvec_sparsify(fv);
 }
 
+/**
+ * Adds a feature to the counters of a similarity hash. The bits of the
+ * feature are expanded to +1 and -1 without branches, such that the
+ * accumulation can be vectorized by the compiler.
+ * @param acc Counters
+ * @param hash Feature
+ * @param v Value of feature
+ * @param num Number of bits
+ */
+static inline void simhash_put(float *acc, feat_t hash, float v, int num)
+{
+    int j;
+
+#ifdef HAVE_OPENMP
+#pragma omp simd
+#endif
+    for (j = 0; j < num; j++)
+        acc[j] += v * (float) ((int) ((hash >> j) & 1) * 2 - 1);
+}
+
+/**
+ * Packs the signs of the counters of a similarity hash
+ * @param acc Counters
+ * @param num Number of bits
+ * @return packed signature
+ */
+static uint64_t simhash_pack(const float *acc, int num)
+{
+    uint64_t sign = 0;
+    int j;
+
+    for (j = 0; j < num; j++)
+        sign |= (uint64_t) (acc[j] > 0) << j;
+
+    return sign;
+}
+
+/**
+ * Computes a similarity hash of a feature vector and returns it as a
+ * packed signature.
+ *
+ * @param fv Feature vector
+ * @param num Number of bits (at most 64)
+ * @return packed signature
+ */
+uint64_t simhash_sign(fvec_t *fv, int num)
+{
+    assert(fv && num > 0 && num <= SIMHASH_MAX);
+    float acc[SIMHASH_MAX] = { 0 };
+    int i;
+
+    /* Compute aggregated feature hashes */
+    for (i = 0; i < fv->len; i++)
+        simhash_put(acc, fv->dim[i], fv->val[i], num);
+
+    return simhash_pack(acc, num);
+}
+
+/**
+ * Returns the number of bits of a similarity hash
+ * @param num Requested number of bits
+ * @return number of bits
+ */
+static int simhash_bits(int num)
+{
+    cfg_int hash_bits;
+
+    config_lookup_int(&cfg, "features.hash_bits", &hash_bits);
+
+    if (num > hash_bits)
+        num = hash_bits;
+    if (num > SIMHASH_MAX)
+        num = SIMHASH_MAX;
+
+    return num;
+}
+
+/**
+ * Returns the number of bits of the signatures of the configured
+ * reduction. Similarity hashes are limited by the hash bits, while the
+ * other methods yield the requested number of bits.
+ * @param num Requested number of bits
+ * @return number of bits
+ */
+int reduce_bits(int num)
+{
+    const char *method;
+
+    config_lookup_string(&cfg, "filter.dim_reduce", &method);
+    if (!strcasecmp(method, "simhash"))
+        return simhash_bits(num);
+
+    return num;
+}
+
 /**
  * Reduce the feature vector to a similarity hash. The string features
  * associated with each dimension are hashed and aggregated to a single hash
@@ -69,61 +238,157 @@ void dim_reduce(fvec_t *fv)
 void reduce_simhash(fvec_t *fv, int num)
 {
     assert(fv && num > 0);
-    feat_t *dim;
-    float *val;
-    int i, j;
-    cfg_int hash_bits;
+    uint64_t sign;
 
-    config_lookup_int(&cfg, "features.hash_bits", &hash_bits);
+    num = simhash_bits(num);
+    sign = simhash_sign(fv, num);
+    reduce_unpack(fv, &sign, num);
+}
 
-    if (num > hash_bits)
-        num = hash_bits;
+/**
+ * Updates the minimum hash values of all rounds with a feature. The
+ * hash functions are derived from precomputed seeds.
+ * @param f Feature
+ * @param mins Minimum hash values of rounds
+ * @param seeds Seeds of rounds
+ * @param rounds Number of rounds
+ * @param mask Mask of hash bits
+ */
+static inline void minhash_put(feat_t f, feat_t *mins, const uint64_t *seeds,
+                               int rounds, feat_t mask)
+{
+    int i;
+
+#ifdef HAVE_OPENMP
+#pragma omp simd
+#endif
+    for (i = 0; i < rounds; i++) {
+        feat_t h = (f ^ seeds[i]) & mask;
+        mins[i] = h < mins[i] ? h : mins[i];
+    }
+}
 
-    dim = (feat_t *) calloc(num, sizeof(feat_t));
-    val = (float *) calloc(num, sizeof(float));
+/**
+ * Updates the minimum hash value of one round (bin) with a feature
+ * using one-permutation hashing as proposed by Li et al. (NIPS 2012).
+ * Each feature is hashed once and assigned to one of the rounds.
+ * @param f Feature
+ * @param mins Minimum hash values of rounds
+ * @param rounds Number of rounds
+ * @param mask Mask of hash bits
+ */
+static inline void minhash_put_oph(feat_t f, feat_t *mins, int rounds,
+                                   feat_t mask)
+{
+    uint64_t h = hash_mix(f);
+    int b = (int) (((h >> 32) * (uint64_t) rounds) >> 32);
 
-    if (!dim || !val) {
-        error("Could not allocate feature vector contents");
-        free(dim);
-        free(val);
-        return;
-    }
+    h = h & mask;
+    if (h < mins[b])
+        mins[b] = h;
+}
 
-    /* Compute aggregated feature hashes */
-    for (i = 0; i < fv->len; i++) {
-        feat_t hash = fv->dim[i];
-        for (j = 0; j < num; j++) {
-            if (hash & 1)
-                val[j] += fv->val[i];
-            else
-                val[j] -= fv->val[i];
-            hash = hash >> 1;
-        }
+/**
+ * Fills empty bins of one-permutation hashing by rotation from the next
+ * non-empty bin as proposed by Shrivastava and Li (ICML 2014).
+ * @param mins Minimum hash values of rounds
+ * @param rounds Number of rounds
+ * @param mask Mask of hash bits
+ */
+static void minhash_densify(feat_t *mins, int rounds, feat_t mask)
+{
+    int i, t;
+
+    /* Densification by rotation (backwards to reuse filled bins) */
+    for (i = rounds - 1; i >= 0; i--) {
+        if (mins[i] != FEAT_MAX)
+            continue;
+        for (t = 1; mins[(i + t) % rounds] == FEAT_MAX; t++);
+        mins[i] = (mins[(i + t) % rounds] + t * OPH_OFFSET) & mask;
     }
+}
 
-    /* Set indices */
-    for (j = 0; j < num; j++)
-        dim[j] = j;
+/**
+ * State of a minimum hash computed feature by feature
+ */
+typedef struct
+{
+    feat_t *mins;           /**< Minimum hash values of rounds */
+    uint64_t *seeds;        /**< Seeds of rounds */
+    int rounds;             /**< Number of rounds */
+    int hash_bits;          /**< Bits per round */
+    feat_t mask;            /**< Mask of hash bits */
+    int oph;                /**< One-permutation hashing */
+} minhash_t;
 
-    /* Binarize feature hash */
-    for (j = 0; j < num; j++)
-        val[j] = val[j] > 0 ? 1 : 0;
+/**
+ * Initializes the state of a minimum hash
+ * @param m State
+ * @param num Number of bits
+ * @return 1 on success, 0 otherwise
+ */
+static int minhash_init(minhash_t *m, int num)
+{
+    cfg_int hash_bits;
+    int i;
 
-    /* Exchange data */
-    free(fv->dim);
-    free(fv->val);
+    config_lookup_int(&cfg, "features.hash_bits", &hash_bits);
+    config_lookup_bool(&cfg, "filter.minhash_oph", &m->oph);
+
+    if (hash_bits > FEAT_BITS)
+        hash_bits = FEAT_BITS;
+
+    m->hash_bits = hash_bits;
+    m->rounds = (num + hash_bits - 1) / hash_bits;
+    m->mask = ((feat_t) 2 << (hash_bits - 1)) - 1;
+    m->mins = (feat_t *) malloc(m->rounds * sizeof(feat_t));
+    m->seeds = (uint64_t *) malloc(m->rounds * sizeof(uint64_t));
+
+    if (!m->mins || !m->seeds) {
+        error("Could not allocate state of minhash");
+        free(m->mins);
+        free(m->seeds);
+        return FALSE;
+    }
 
-    fv->dim = dim;
-    fv->val = val;
-    fv->len = num;
+    for (i = 0; i < m->rounds; i++) {
+        m->seeds[i] = rehash_seed(i);
+        m->mins[i] = FEAT_MAX;
+    }
+
+    return TRUE;
 }
 
+/**
+ * Finishes a minimum hash and returns it as packed bits
+ * @param m State
+ * @param bits Packed bits
+ * @param num Number of bits
+ * @param empty No features have been added
+ */
+static void minhash_finish(minhash_t *m, uint64_t *bits, int num, int empty)
+{
+    int i;
+
+    /* No features, no densification */
+    if (m->oph && !empty)
+        minhash_densify(m->mins, m->rounds, m->mask);
+
+    /* Fill hash bits */
+    for (i = 0; i < num; i++)
+        if ((m->mins[i / m->hash_bits] >> (i % m->hash_bits)) & 1)
+            BITS_SET(bits, i);
+
+    free(m->mins);
+    free(m->seeds);
+}
 
 /**
  * Reduce the feature vector to a minimum hash. The string features
  * associated with each dimension are hashed and sorted multiple times as
  * proposed by Broder (1997).  In each round the smallest hash value is
- * appended to the minimum hash.  
+ * appended to the minimum hash.  Optionally, the rounds are computed
+ * using one-permutation hashing.
  *
  * @param fv Feature vector
  * @param num Number of bits
@@ -131,53 +396,46 @@ void reduce_simhash(fvec_t *fv, int num)
 void reduce_minhash(fvec_t *fv, int num)
 {
     assert(fv && num > 0);
-    feat_t *dim, min_hash = 0;
-    float *val;
-    int i, j, k;
-    cfg_int hash_bits;
-
-    config_lookup_int(&cfg, "features.hash_bits", &hash_bits);
+    uint64_t *bits;
+    minhash_t m;
+    int k;
 
-    dim = (feat_t *) calloc(num, sizeof(feat_t));
-    val = (float *) calloc(num, sizeof(float));
-
-    if (!dim || !val) {
+    bits = (uint64_t *) calloc(BITS_WORDS(num), sizeof(uint64_t));
+    if (!bits || !minhash_init(&m, num)) {
         error("Could not allocate feature vector contents");
-        free(dim);
-        free(val);
+        free(bits);
         return;
     }
 
-    /* Fill hash bits */
-    for (i = 0, j = 0; i < num; i++, j++) {
-
-        /* Determine minimum hash value */
-        if (i % hash_bits == 0) {
-            min_hash = UINT64_MAX;
-            for (k = 0; k < fv->len; k++) {
-                /* Re-hash feature depending on round */
-                feat_t h = rehash(fv->dim[k], i / hash_bits);
-                h = h & ((1 << hash_bits) - 1);
-
-                if (h < min_hash)
-                    min_hash = h;
-            }
-            j = 0;
-        }
-
-        dim[i] = i;
-        val[i] = (min_hash >> j) & 1;
+    /* Determine minimum hash values */
+    for (k = 0; k < fv->len; k++) {
+        if (m.oph)
+            minhash_put_oph(fv->dim[k], m.mins, m.rounds, m.mask);
+        else
+            minhash_put(fv->dim[k], m.mins, m.seeds, m.rounds, m.mask);
     }
 
-    /* Exchange data */
-    free(fv->dim);
-    free(fv->val);
-
-    fv->dim = dim;
-    fv->val = val;
-    fv->len = num;
+    minhash_finish(&m, bits, num, fv->len == 0);
+    reduce_unpack(fv, bits, num);
+    free(bits);
 }
 
+/**
+ * Adds a feature to a Bloom filter using k hash functions
+ * @param bits Packed bits of filter
+ * @param f Feature
+ * @param k Number of hash functions
+ * @param num Number of bits
+ */
+static inline void bloom_put(uint64_t *bits, feat_t f, int k, int num)
+{
+    int i;
+
+    for (i = 0; i < k; i++) {
+        uint64_t h = rehash(f, i);
+        BITS_SET(bits, h % num);
+    }
+}
 
 /**
  * Reduce the feature vector to a small Bloom filter.  The string features
@@ -191,14 +449,51 @@ void reduce_minhash(fvec_t *fv, int num)
 void reduce_bloom(fvec_t *fv, int num)
 {
     assert(fv && num > 0);
-    feat_t *dim;
-    float *val;
-    int i, k;
+    uint64_t *bits;
+    int i;
     cfg_int bloom_num;
 
     config_lookup_int(&cfg, "filter.bloom_num", &bloom_num);
 
-    dim = (feat_t *) calloc(num, sizeof(feat_t));
+    bits = (uint64_t *) calloc(BITS_WORDS(num), sizeof(uint64_t));
+    if (!bits) {
+        error("Could not allocate feature vector contents");
+        return;
+    }
+
+    /* Fill Bloom filter */
+    for (i = 0; i < fv->len; i++)
+        bloom_put(bits, fv->dim[i], bloom_num, num);
+
+    reduce_unpack(fv, bits, num);
+    free(bits);
+}
+
+/**
+ * Reduce the feature vector to a dense vector using a very sparse
+ * random projection as proposed by Achlioptas (PODS 2001) and Li et al.
+ * (KDD 2006).  The entry of the projection matrix for a dimension and
+ * an output is derived on the fly by hashing both, such that no matrix
+ * is stored.  The hashing is inlined to vectorize the loop over the
+ * outputs.  With probability 1/s the entry is +sqrt(s) or -sqrt(s)
+ * and otherwise 0, where s is the sparsity.  The output is scaled by
+ * 1/sqrt(num) to preserve distances in expectation.
+ *
+ * @param fv Feature vector
+ * @param num Number of output dimensions
+ */
+void reduce_randproj(fvec_t *fv, int num)
+{
+    assert(fv && num > 0);
+    feat_t *dim;
+    float *val, scale;
+    uint32_t thres;
+    cfg_int sparsity;
+    int i, j;
+
+    config_lookup_int(&cfg, "filter.randproj_sparsity", &sparsity);
+
+    dim = (feat_t *) malloc(num * sizeof(feat_t));
     val = (float *) calloc(num, sizeof(float));
 
     if (!dim || !val) {
@@ -208,18 +503,37 @@ void reduce_bloom(fvec_t *fv, int num)
         return;
     }
 
-    /* Fill dimension indices */
-    for (i = 0; i < num; i++)
-        dim[i] = i;
+    /* Entries are non-zero if the lower half of the hash is small */
+    thres = (uint32_t) (UINT32_MAX / sparsity);
+    scale = (float) sqrt((double) sparsity / num);
 
-    /* Fill Bloom filter */
     for (i = 0; i < fv->len; i++) {
-        for (k = 0; k < bloom_num; k++) {
-            feat_t h = rehash(fv->dim[i], k);
-            val[h % num] = 1.0;
+        uint64_t f = hash_mix(fv->dim[i]);
+        float v = fv->val[i];
+#ifdef HAVE_OPENMP
+#pragma omp simd
+#endif
+        for (j = 0; j < num; j++) {
+            /* Finalizer of MurmurHash3 as in hash_mix() */
+            uint64_t h = f + (uint64_t) j * RANDPROJ_STEP;
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 33;
+
+            int nz = (uint32_t) h < thres;
+            int sg = (int) (h >> 63) * 2 - 1;
+            val[j] += v * (float) (nz * sg);
         }
     }
 
+    /* Scale after accumulation, such that counts cancel exactly */
+    for (j = 0; j < num; j++) {
+        dim[j] = j;
+        val[j] *= scale;
+    }
+
     /* Exchange data */
     free(fv->dim);
     free(fv->val);
@@ -227,6 +541,225 @@ void reduce_bloom(fvec_t *fv, int num)
     fv->dim = dim;
     fv->val = val;
     fv->len = num;
+    fv->size = num;
+}
+
+/**
+ * State of a reduction fed directly by the feature extraction
+ */
+typedef struct
+{
+    int method;             /**< Reduction method */
+    int num;                /**< Number of bits */
+    unsigned long len;      /**< Number of distinct features */
+    float acc[SIMHASH_MAX]; /**< Counters of simhash */
+    feat_t *set;            /**< Set of seen features (simhash) */
+    unsigned long set_size; /**< Size of set (power of two) */
+    int set_zero;           /**< Zero feature seen (simhash) */
+    minhash_t minhash;      /**< State of minhash */
+    uint64_t *bits;         /**< Packed bits of Bloom filter */
+    cfg_int bloom_num;      /**< Number of hash functions of filter */
+} fused_t;
+
+/* Reduction is fused with extraction */
+static int fused = FALSE;
+static int fused_method = REDUCE_NONE;
+
+/**
+ * Parses the method of dimension reduction
+ * @param method Name of method
+ * @return method
+ */
+static int reduce_method(const char *method)
+{
+    if (!strcasecmp(method, "simhash"))
+        return REDUCE_SIMHASH;
+    if (!strcasecmp(method, "minhash"))
+        return REDUCE_MINHASH;
+    if (!strcasecmp(method, "bloom"))
+        return REDUCE_BLOOM;
+    return REDUCE_NONE;
+}
+
+/**
+ * Checks whether the reduction can be fused with the extraction. This
+ * is the case for the binary embedding, where the reductions only
+ * depend on the set of features, and if no later stage needs the
+ * complete vector.
+ */
+void reduce_init()
+{
+    const char *method, *embed, *norm;
+    double tl, th;
+    int sign;
+
+    config_lookup_string(&cfg, "filter.dim_reduce", &method);
+    config_lookup_string(&cfg, "features.vect_embed", &embed);
+    config_lookup_string(&cfg, "features.vect_norm", &norm);
+    config_lookup_float(&cfg, "features.thres_low", &tl);
+    config_lookup_float(&cfg, "features.thres_high", &th);
+    config_lookup_bool(&cfg, "features.vect_sign", &sign);
+
+    fused_method = reduce_method(method);
+    fused = fused_method != REDUCE_NONE && !strcasecmp(embed, "bin") &&
+        !strcasecmp(norm, "none") && tl <= 1 && (th == 0 || th >= 1) &&
+        !sign && !fhash_enabled() && !vocab_enabled() &&
+        !fselect_enabled() && !fwindow_enabled();
+}
+
+/**
+ * Checks whether the reduction is fused with the extraction
+ * @return 1 if fused, 0 otherwise
+ */
+int reduce_fused()
+{
+    return fused;
+}
+
+/**
+ * Inserts a feature into the set of seen features. The set is an
+ * open-addressing table that is doubled if half full.
+ * @param r State
+ * @param f Feature
+ * @return 1 if the feature is new, 0 otherwise
+ */
+static int fused_insert(fused_t *r, feat_t f)
+{
+    unsigned long i, j, mask = r->set_size - 1;
+    feat_t *set;
+
+    /* Zero marks empty slots and is tracked separately */
+    if (f == 0) {
+        if (r->set_zero)
+            return FALSE;
+        return r->set_zero = TRUE;
+    }
+
+    for (i = hash_mix(f) & mask; r->set[i]; i = (i + 1) & mask)
+        if (r->set[i] == f)
+            return FALSE;
+    r->set[i] = f;
+
+    if (2 * (r->len + 1) < r->set_size)
+        return TRUE;
+
+    /* Rehash into table of double size */
+    set = calloc(2 * r->set_size, sizeof(feat_t));
+    if (!set) {
+        error("Could not enlarge set of features");
+        return TRUE;
+    }
+
+    mask = 2 * r->set_size - 1;
+    for (j = 0; j < r->set_size; j++) {
+        if (!r->set[j])
+            continue;
+        for (i = hash_mix(r->set[j]) & mask; set[i]; i = (i + 1) & mask);
+        set[i] = r->set[j];
+    }
+
+    free(r->set);
+    r->set = set;
+    r->set_size *= 2;
+    return TRUE;
+}
+
+/**
+ * Feeds a feature into the reduction (callback of sink)
+ * @param ctx State
+ * @param f Feature
+ */
+static void fused_put(void *ctx, feat_t f)
+{
+    fused_t *r = ctx;
+    minhash_t *m = &r->minhash;
+
+    switch (r->method) {
+    case REDUCE_SIMHASH:
+        /* Binary embedding counts each feature once */
+        if (fused_insert(r, f)) {
+            simhash_put(r->acc, f, 1, r->num);
+            r->len++;
+        }
+        break;
+    case REDUCE_MINHASH:
+        if (m->oph)
+            minhash_put_oph(f, m->mins, m->rounds, m->mask);
+        else
+            minhash_put(f, m->mins, m->seeds, m->rounds, m->mask);
+        r->len++;
+        break;
+    case REDUCE_BLOOM:
+        bloom_put(r->bits, f, r->bloom_num, r->num);
+        r->len++;
+        break;
+    }
+}
+
+/**
+ * Extracts a reduced feature vector from a string without
+ * materializing the sparse vector. The n-grams are fed directly into
+ * the counters of simhash, the minimum hash values or the bits of the
+ * Bloom filter. The result equals the binary embedding followed by the
+ * reduction.
+ * @param x String of bytes
+ * @param l Length of string
+ * @return reduced feature vector
+ */
+fvec_t *reduce_extract(char *x, int l)
+{
+    fsink_t sink;
+    fvec_t *fv;
+    fused_t r;
+    cfg_int num;
+
+    memset(&r, 0, sizeof(fused_t));
+    config_lookup_int(&cfg, "filter.dim_num", &num);
+    config_lookup_int(&cfg, "filter.bloom_num", &r.bloom_num);
+
+    r.method = fused_method;
+    r.num = r.method == REDUCE_SIMHASH ? simhash_bits(num) : num;
+    r.bits = (uint64_t *) calloc(BITS_WORDS(r.num), sizeof(uint64_t));
+
+    fv = calloc(1, sizeof(fvec_t));
+    if (!fv || !r.bits) {
+        error("Could not allocate feature vector");
+        goto err;
+    }
+
+    if (r.method == REDUCE_SIMHASH) {
+        r.set_size = 256;
+        r.set = calloc(r.set_size, sizeof(feat_t));
+        if (!r.set) {
+            error("Could not allocate set of features");
+            goto err;
+        }
+    } else if (r.method == REDUCE_MINHASH && !minhash_init(&r.minhash, r.num)) {
+        goto err;
+    }
+
+    sink.put = fused_put;
+    sink.ctx = &r;
+    fv->total = fvec_extract_sink(x, l, &sink);
+
+    /* Pack reduced vector */
+    if (r.method == REDUCE_SIMHASH)
+        r.bits[0] = simhash_pack(r.acc, r.num);
+    else if (r.method == REDUCE_MINHASH)
+        minhash_finish(&r.minhash, r.bits, r.num, r.len == 0);
+
+    reduce_unpack(fv, r.bits, r.num);
+    fvec_sparsify(fv);
+
+    free(r.set);
+    free(r.bits);
+    return fv;
+
+  err:
+    free(fv);
+    free(r.set);
+    free(r.bits);
+    return NULL;
 }
 
 /** @} */
@@ -14,9 +14,34 @@
 
 #include "fvec.h"
 
+/** Maximum number of bits of a similarity hash */
+#define SIMHASH_MAX     64
+/** Offset for densification of one-permutation hashing */
+#define OPH_OFFSET      0x9e3779b97f4a7c15ULL
+/** Step between the hashes of outputs of random projection */
+#define RANDPROJ_STEP   0x9e3779b97f4a7c15ULL
+
+/** Methods of dimension reduction */
+#define REDUCE_NONE     0
+#define REDUCE_SIMHASH  1
+#define REDUCE_MINHASH  2
+#define REDUCE_BLOOM    3
+
+/* Macros for packed bit signatures */
+#define BITS_WORDS(n)   (((n) + 63) / 64)
+#define BITS_SET(b,i)   ((b)[(i) / 64] |= (uint64_t) 1 << ((i) % 64))
+#define BITS_GET(b,i)   (((b)[(i) / 64] >> ((i) % 64)) & 1)
+
 void dim_reduce(fvec_t *fv);
 void reduce_simhash(fvec_t *fv, int num);
+uint64_t simhash_sign(fvec_t *fv, int num);
+void reduce_pack(fvec_t *fv, uint8_t *buf, int num);
+int reduce_bits(int num);
 void reduce_minhash(fvec_t *fv, int num);
 void reduce_bloom(fvec_t *fv, int num);
+void reduce_randproj(fvec_t *fv, int num);
+void reduce_init();
+int reduce_fused();
+fvec_t *reduce_extract(char *x, int l);
 
 #endif /* REDUCE_H */
@@ -0,0 +1,341 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+/**
+ * @addtogroup fvec Feature vector
+ * <hr>
+ * Vocabulary of frequent features. In a pre-pass over the input the
+ * features with the highest document frequencies are determined in
+ * bounded memory using the Space-Saving algorithm (Metwally et al.,
+ * ICDT 2005). The selected features are stored as a feature vector of
+ * estimated document frequencies. During extraction, the features of
+ * the vocabulary are mapped to the dense dimensions 0 to K - 1 in the
+ * order of their hash values and all other features are dropped.
+ * @author Konrad Rieck (konrad@mlsec.org)
+ * @{
+ */
+
+#include "config.h"
+#include "common.h"
+#include "fvec.h"
+#include "fhash.h"
+#include "fmath.h"
+#include "vocab.h"
+#include "fmask.h"
+#include "util.h"
+#include "input.h"
+
+/**
+ * Counter of the Space-Saving algorithm
+ */
+typedef struct
+{
+    feat_t dim;             /**< Feature */
+    uint64_t cnt;           /**< Estimated document frequency */
+    unsigned long heap;     /**< Position in heap */
+    UT_hash_handle hh;      /**< Uthash handle */
+} vcount_t;
+
+/* External variables */
+extern config_t cfg;
+
+/* Vocabulary */
+static fvec_t *vocab = NULL;
+
+/* Counters of the pre-pass */
+static vcount_t *counts = NULL;
+static vcount_t *table = NULL;
+static vcount_t **heap = NULL;
+static unsigned long heap_len = 0, heap_size = 0;
+
+/**
+ * Restores the heap property below a counter whose count has grown.
+ * @param i Position in heap
+ */
+static void heap_down(unsigned long i)
+{
+    vcount_t *c = heap[i];
+    unsigned long j;
+
+    while ((j = 2 * i + 1) < heap_len) {
+        if (j + 1 < heap_len && heap[j + 1]->cnt < heap[j]->cnt)
+            j++;
+        if (c->cnt <= heap[j]->cnt)
+            break;
+        heap[i] = heap[j];
+        heap[i]->heap = i;
+        i = j;
+    }
+
+    heap[i] = c;
+    c->heap = i;
+}
+
+/**
+ * Counts a feature. If no counter is available, the counter with the
+ * smallest count is assigned to the feature and incremented.
+ * @param dim Feature
+ */
+static void vocab_count(feat_t dim)
+{
+    vcount_t *c;
+    unsigned long i;
+
+    HASH_FIND(hh, table, &dim, sizeof(feat_t), c);
+    if (c) {
+        c->cnt++;
+        heap_down(c->heap);
+        return;
+    }
+
+    if (heap_len < heap_size) {
+        /* Free counter with the minimum count of zero */
+        c = counts + heap_len;
+        c->dim = dim;
+        c->cnt = 1;
+        HASH_ADD(hh, table, dim, sizeof(feat_t), c);
+
+        /* Sift up, since all other counts are at least one */
+        for (i = heap_len++; i > 0 && heap[(i - 1) / 2]->cnt > 1;
+             i = (i - 1) / 2) {
+            heap[i] = heap[(i - 1) / 2];
+            heap[i]->heap = i;
+        }
+        heap[i] = c;
+        c->heap = i;
+        return;
+    }
+
+    /* Replace counter with minimum count */
+    c = heap[0];
+    HASH_DEL(table, c);
+    c->dim = dim;
+    c->cnt++;
+    HASH_ADD(hh, table, dim, sizeof(feat_t), c);
+    heap_down(0);
+}
+
+/**
+ * Compares two counters by count and feature (for qsort)
+ * @param x Counter
+ * @param y Counter
+ * @return comparison
+ */
+static int cmp_count(const void *x, const void *y)
+{
+    const vcount_t *a = *(vcount_t **) x, *b = *(vcount_t **) y;
+
+    if (a->cnt != b->cnt)
+        return a->cnt < b->cnt ? 1 : -1;
+    return (a->dim > b->dim) - (a->dim < b->dim);
+}
+
+/**
+ * Compares two features (for qsort)
+ * @param x Feature
+ * @param y Feature
+ * @return comparison
+ */
+static int cmp_dim(const void *x, const void *y)
+{
+    const vcount_t *a = *(vcount_t **) x, *b = *(vcount_t **) y;
+    return (a->dim > b->dim) - (a->dim < b->dim);
+}
+
+/**
+ * Selects the features with the highest counts as vocabulary.
+ * @param num Size of vocabulary
+ */
+static void vocab_select(unsigned long num)
+{
+    unsigned long i;
+
+    if (num > heap_len)
+        num = heap_len;
+
+    qsort(heap, heap_len, sizeof(vcount_t *), cmp_count);
+    qsort(heap, num, sizeof(vcount_t *), cmp_dim);
+
+    vocab = fvec_zero();
+    if (!vocab || !fvec_reserve(vocab, num)) {
+        error("Could not allocate vocabulary");
+        return;
+    }
+
+    for (i = 0; i < num; i++) {
+        vocab->dim[i] = heap[i]->dim;
+        vocab->val[i] = (float) heap[i]->cnt;
+    }
+    vocab->len = num;
+}
+
+/**
+ * Determines the vocabulary from the input in a pre-pass.
+ * @param input Input source
+ * @param num Size of vocabulary
+ */
+static void vocab_count_input(char *input, unsigned long num)
+{
+    long read, entries, i, j, k;
+    cfg_int chunk;
+    const char *in_format;
+
+    config_lookup_string(&cfg, "input.input_format", &in_format);
+    config_lookup_int(&cfg, "input.chunk_size", &chunk);
+
+    /* Standard input can only be read once */
+    if (!strcasecmp(in_format, "stdin"))
+        fatal("Vocabulary can not be determined from standard input.");
+
+    string_t *strs = malloc(sizeof(string_t) * chunk);
+    heap_size = VOCAB_COUNTERS * num;
+    counts = calloc(heap_size, sizeof(vcount_t));
+    heap = malloc(heap_size * sizeof(vcount_t *));
+    if (!strs || !counts || !heap) {
+        error("Could not allocate vocabulary counters");
+        goto out;
+    }
+
+    input_config(in_format);
+    entries = input_open(input);
+    if (entries <= 0) {
+        error("Could not open input for determining vocabulary");
+        goto out;
+    }
+
+    info_msg(1, "Determining vocabulary from %d strings in chunks of %d.",
+             entries, chunk);
+
+    for (i = 0, read = 0; i < entries; i += read) {
+        read = input_read(strs, chunk);
+        if (read <= 0)
+            break;
+
+        /* Preprocess strings as for the embedding */
+        input_preproc(strs, read);
+
+        for (j = 0; j < read; j++) {
+            fvec_t *x = fvec_extract_intern(strs[j].str, strs[j].len);
+            for (k = 0; k < x->len; k++)
+                vocab_count(x->dim[k]);
+            fvec_destroy(x);
+        }
+
+        input_free(strs, read);
+        prog_bar(0, entries, i + read);
+    }
+
+    input_close();
+    vocab_select(num);
+
+  out:
+    HASH_CLEAR(hh, table);
+    free(strs);
+    free(counts);
+    free(heap);
+    counts = NULL;
+    heap = NULL;
+    heap_len = heap_size = 0;
+}
+
+/**
+ * Loads or determines the vocabulary of frequent features. If the
+ * vocabulary file does not exist, it is determined from the input and
+ * saved to the file.
+ * @param input Input source
+ */
+void vocab_create(char *input)
+{
+    const char *vocab_file;
+    cfg_int num;
+
+    config_lookup_string(&cfg, "features.vocab_file", &vocab_file);
+    config_lookup_int(&cfg, "features.vocab_size", &num);
+
+    if (!access(vocab_file, R_OK)) {
+        info_msg(1, "Loading vocabulary from '%s'.", vocab_file);
+        vocab = fvec_load((char *) vocab_file);
+    } else {
+        vocab_count_input(input, num);
+        if (!vocab)
+            return;
+
+        info_msg(1, "Saving vocabulary of %lu features to '%s'.",
+                 vocab->len, vocab_file);
+        fvec_save(vocab, (char *) vocab_file);
+    }
+
+    /* Drop other features already during extraction */
+    if (vocab)
+        fmask_create(vocab);
+}
+
+/**
+ * Destroys the vocabulary
+ */
+void vocab_destroy()
+{
+    if (vocab)
+        fmask_destroy();
+    fvec_destroy(vocab);
+    vocab = NULL;
+}
+
+/**
+ * Checks whether a vocabulary is used
+ * @return 1 if enabled, 0 otherwise
+ */
+int vocab_enabled()
+{
+    return vocab != NULL;
+}
+
+/**
+ * Returns the size of the vocabulary
+ * @return number of features
+ */
+unsigned long vocab_size()
+{
+    return vocab ? vocab->len : 0;
+}
+
+/**
+ * Maps the features of a vector to the dense dimensions of the
+ * vocabulary and drops all other features. As both lists are sorted,
+ * the search for each feature starts at the previous match and the
+ * mapped dimensions remain sorted.
+ * @param fv Feature vector
+ */
+void vocab_map(fvec_t *fv)
+{
+    unsigned long i, j = 0, lo = 0, hi, mid;
+    int hit;
+
+    for (i = 0; i < fv->len; i++) {
+        hi = vocab->len;
+        while (lo < hi) {
+            mid = lo + ((hi - lo) >> 1);
+            if (vocab->dim[mid] < fv->dim[i])
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        hit = lo < vocab->len && vocab->dim[lo] == fv->dim[i];
+        fv->dim[j] = lo;
+        fv->val[j] = fv->val[i];
+        j += hit;
+    }
+
+    fv->len = j;
+}
+
+/** @} */
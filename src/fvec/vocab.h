@@ -0,0 +1,26 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+#ifndef VOCAB_H
+#define VOCAB_H
+
+#include "fvec.h"
+
+/** Number of counters per selected feature in the pre-pass */
+#define VOCAB_COUNTERS  4
+
+void vocab_create(char *input);
+void vocab_destroy();
+int vocab_enabled();
+void vocab_map(fvec_t *fv);
+unsigned long vocab_size();
+
+#endif /* VOCAB_H */
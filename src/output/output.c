@@ -22,6 +22,8 @@
 #include "common.h"
 #include "util.h"
 #include "output.h"
+#include "fhash.h"
+#include "fdict.h"
 
 /* Modules */
 #include "output_libsvm.h"
@@ -30,6 +32,12 @@
 #include "output_cluto.h"
 #include "output_stdout.h"
 #include "output_json.h"
+#include "output_bits.h"
+#include "output_lsh.h"
+#include "output_matrix.h"
+#include "output_fvec.h"
+#include "output_knn.h"
+#include "output_score.h"
 
 /**
  * Structure for output interface
@@ -73,6 +81,30 @@ void output_config(const char *format)
         func.output_open = output_json_open;
         func.output_write = output_json_write;
         func.output_close = output_json_close;
+    } else if (!strcasecmp(format, "bits")) {
+        func.output_open = output_bits_open;
+        func.output_write = output_bits_write;
+        func.output_close = output_bits_close;
+    } else if (!strcasecmp(format, "lsh")) {
+        func.output_open = output_lsh_open;
+        func.output_write = output_lsh_write;
+        func.output_close = output_lsh_close;
+    } else if (!strcasecmp(format, "matrix")) {
+        func.output_open = output_matrix_open;
+        func.output_write = output_matrix_write;
+        func.output_close = output_matrix_close;
+    } else if (!strcasecmp(format, "fvec")) {
+        func.output_open = output_fvec_open;
+        func.output_write = output_fvec_write;
+        func.output_close = output_fvec_close;
+    } else if (!strcasecmp(format, "knn")) {
+        func.output_open = output_knn_open;
+        func.output_write = output_knn_write;
+        func.output_close = output_knn_close;
+    } else if (!strcasecmp(format, "score")) {
+        func.output_open = output_score_open;
+        func.output_write = output_score_write;
+        func.output_close = output_score_close;
     } else {
         error("Unknown ouptut format '%s', using 'text' instead.", format);
         output_config("text");
@@ -122,4 +154,36 @@ void output_free(fvec_t **x, int len)
         fvec_destroy(x[j]);
 }
 
+/**
+ * Checks whether the strings of features are available, either from
+ * the explicit hash table or the dictionary of features.
+ * @return 1 if available, 0 otherwise
+ */
+int output_feat_enabled(void)
+{
+    return fhash_enabled() || fdict_enabled();
+}
+
+/**
+ * Returns the string of a feature
+ * @warning The returned memory must not be freed.
+ * @param dim Dimension of feature
+ * @param len Length of string
+ * @return string or NULL if not available
+ */
+char *output_feat_get(feat_t dim, int *len)
+{
+    fentry_t *fe;
+
+    if (fdict_enabled())
+        return fdict_get(dim, len);
+
+    fe = fhash_get(dim);
+    if (!fe)
+        return NULL;
+
+    *len = fe->len;
+    return fe->data;
+}
+
 /** @} */
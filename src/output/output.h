@@ -23,4 +23,8 @@ int output_open(char *);
 int output_write(fvec_t **, int);
 void output_close(void);
 
+/* Strings of features */
+int output_feat_enabled(void);
+char *output_feat_get(feat_t, int *);
+
 #endif /* OUTPUT_H */
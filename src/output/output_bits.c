@@ -0,0 +1,135 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details. 
+ */
+
+/** 
+ * @addtogroup output
+ * <hr> 
+ * <em>bits</em>: The vectors are exported as packed bit signatures of
+ * fixed width. This format is intended for vectors reduced using
+ * simhash, minhash or Bloom filters. Each vector is stored as
+ * ceil(bits / 8) bytes, where bits is dim_num or, for simhash, at most
+ * hash_bits and 64. Bit i of the signature is stored in byte i / 8 at
+ * position i % 8. Labels and sources are written to a separate text
+ * file with the suffix ".meta" in the form
+ * <pre> label source </pre>
+ * @{
+ */
+
+#include "config.h"
+#include "common.h"
+#include "util.h"
+#include "output.h"
+#include "sally.h"
+#include "reduce.h"
+
+/* External variables */
+extern config_t cfg;
+
+/* Local variables */
+static FILE *f = NULL;
+static FILE *m = NULL;
+static uint8_t *buf = NULL;
+static int bits = 0;
+static int skip_null = CONFIG_FALSE;
+
+/**
+ * Opens a file for writing bit signatures
+ * @param fn File name
+ * @return number of regular files
+ */
+int output_bits_open(char *fn)
+{
+    assert(fn);
+    char meta[MAX_PATH_LEN];
+    const char *method;
+    cfg_int dim_num;
+
+    config_lookup_bool(&cfg, "output.skip_null", &skip_null);
+    config_lookup_string(&cfg, "filter.dim_reduce", &method);
+    config_lookup_int(&cfg, "filter.dim_num", &dim_num);
+
+    if (!strcasecmp(method, "none"))
+        warning("Bit signatures require a dimension reduction.");
+
+    /* Similarity hashes may be shorter than requested */
+    bits = reduce_bits(dim_num);
+    if (bits < dim_num)
+        info_msg(1, "Writing signatures with %d bits.", bits);
+
+    buf = malloc((bits + 7) / 8 + 1);
+    if (!buf) {
+        error("Could not allocate signature buffer");
+        return FALSE;
+    }
+
+    f = fopen(fn, "w");
+    if (!f) {
+        error("Could not open output file '%s'.", fn);
+        return FALSE;
+    }
+
+    snprintf(meta, MAX_PATH_LEN, "%s.meta", fn);
+    m = fopen(meta, "w");
+    if (!m) {
+        error("Could not open output file '%s'.", meta);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Writes a block of files to the output
+ * @param x Feature vectors
+ * @param len Length of block
+ * @return number of written files
+ */
+int output_bits_write(fvec_t **x, int len)
+{
+    assert(x && len >= 0);
+    int j;
+
+    for (j = 0; j < len; j++) {
+        /* Skip null vectors */
+        if (skip_null && x[j]->len == 0)
+            continue;
+
+        reduce_pack(x[j], buf, bits);
+        if (fwrite(buf, 1, (bits + 7) / 8, f) != (bits + 7) / 8) {
+            error("Could not write signature to output file");
+            return FALSE;
+        }
+
+        fprintf(m, "%g", x[j]->label);
+        if (x[j]->src)
+            fprintf(m, " %s", x[j]->src);
+        fprintf(m, "\n");
+    }
+
+    return TRUE;
+}
+
+/**
+ * Closes an open output file.
+ */
+void output_bits_close()
+{
+    if (f)
+        fclose(f);
+    if (m)
+        fclose(m);
+    free(buf);
+
+    f = m = NULL;
+    buf = NULL;
+}
+
+/** @} */
@@ -0,0 +1,89 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details. 
+ */
+
+/** 
+ * @addtogroup output
+ * <hr> 
+ * <em>fvec</em>: The vectors are exported in the compressed binary
+ * format of fvec_write_bin(). The format is not portable across
+ * platforms, but can be read back by Sally quickly, for example, as a
+ * reference set for nearest-neighbor search.
+ * @{
+ */
+
+#include "config.h"
+#include "common.h"
+#include "util.h"
+#include "output.h"
+#include "sally.h"
+
+/* External variables */
+extern config_t cfg;
+
+/* Local variables */
+static gzFile z = NULL;
+static int skip_null = CONFIG_FALSE;
+
+/**
+ * Opens a file for writing binary vectors
+ * @param fn File name
+ * @return number of regular files
+ */
+int output_fvec_open(char *fn)
+{
+    assert(fn);
+
+    z = gzopen(fn, "wb");
+    if (!z) {
+        error("Could not open output file '%s'.", fn);
+        return FALSE;
+    }
+
+    config_lookup_bool(&cfg, "output.skip_null", &skip_null);
+    return TRUE;
+}
+
+/**
+ * Writes a block of files to the output
+ * @param x Feature vectors
+ * @param len Length of block
+ * @return number of written files
+ */
+int output_fvec_write(fvec_t **x, int len)
+{
+    assert(x && len >= 0);
+    int j;
+
+    for (j = 0; j < len; j++) {
+        /* Skip null vectors */
+        if (skip_null && x[j]->len == 0)
+            continue;
+
+        if (!fvec_write_bin(x[j], z)) {
+            error("Could not write vector to output file");
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * Closes an open output file.
+ */
+void output_fvec_close()
+{
+    if (z)
+        gzclose(z);
+    z = NULL;
+}
+
+/** @} */
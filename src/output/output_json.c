@@ -89,19 +89,20 @@ int output_json_write(fvec_t **x, int len)
         }
         fprintf(f, "]");
 
-        /* Print feature if feature hash is enabled */
-        if (fhash_enabled()) {
+        /* Print feature if strings of features are available */
+        if (output_feat_enabled()) {
             fprintf(f, ",\n    \"feat\": [");
             for (i = 0; i < x[j]->len; i++) {
                 /* Print feature (hash and string) */
-                fentry_t *fe = fhash_get(x[j]->dim[i]);
+                int fl = 0;
+                char *fs = output_feat_get(x[j]->dim[i], &fl);
 
                 fprintf(f, "\"");
-                for (k = 0; k < fe->len; k++)
-                    if (isprint(fe->data[k]) && !strchr("%\"\\", fe->data[k]))
-                        fprintf(f, "%c", fe->data[k]);
+                for (k = 0; fs && k < fl; k++)
+                    if (isprint(fs[k]) && !strchr("%\"\\", fs[k]))
+                        fprintf(f, "%c", fs[k]);
                     else
-                        fprintf(f, "%%%.2x", (unsigned char) fe->data[k]);
+                        fprintf(f, "%%%.2x", (unsigned char) fs[k]);
                 fprintf(f, "\"");
 
                 if (i < x[j]->len - 1)
@@ -0,0 +1,539 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details. 
+ */
+
+/** 
+ * @addtogroup output
+ * <hr> 
+ * <em>knn</em>: The vectors are not exported directly. Instead the
+ * k nearest neighbors of each vector in a reference set are determined
+ * and written as a text line of the form
+ * <pre> index:label:score,... # source </pre>
+ * where index is the position of the neighbor in the reference set and
+ * label its label. The reference set is loaded from a file in the
+ * binary format of the output module <em>fvec</em>. An inverted index
+ * over the dimensions of the reference set is used for the search. If
+ * all values are non-negative, the terms of a query are processed in
+ * the order of their maximum contribution and the search for new
+ * candidates stops as soon as the remaining terms can not reach the
+ * current k-th score (MaxScore). The remaining terms are then only
+ * added to the candidates found so far, using the reference vectors
+ * that are kept in compressed form.
+ * @{
+ */
+
+#include "config.h"
+#include "common.h"
+#include "util.h"
+#include "output.h"
+#include "sally.h"
+#include "fmath.h"
+#include "findex.h"
+#include "fzvec.h"
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * Term of a query
+ */
+typedef struct
+{
+    feat_t dim;            /**< Dimension */
+    long post;             /**< Postings of dimension */
+    float val;             /**< Value of query */
+    float bound;           /**< Maximum contribution */
+} knn_term_t;
+
+/**
+ * Workspace of a thread
+ */
+typedef struct
+{
+    float *acc;            /**< Accumulated scores */
+    uint8_t *mark;         /**< Marks of candidates */
+    unsigned long *cand;   /**< List of candidates */
+    knn_term_t *terms;     /**< Terms of query */
+    unsigned long terms_size;   /**< Allocated number of terms */
+    feat_t *rdim;          /**< Dimensions of remaining terms */
+    float *rval;           /**< Values of remaining terms */
+    unsigned long *heap_id;     /**< Heap of best candidates */
+    float *heap_score;     /**< Scores in heap */
+} knn_work_t;
+
+/* External variables */
+extern config_t cfg;
+
+/* Local variables */
+static FILE *f = NULL;
+static int skip_null = CONFIG_FALSE;
+static int cosine = FALSE;
+static int knn = 0;
+static int threads = 1;
+static knn_work_t *work = NULL;
+
+/* Reference set of compressed vectors */
+static fzset_t *zs = NULL;
+static float *labels = NULL;
+static unsigned long num = 0;
+static int nonneg = TRUE;
+static findex_t *idx = NULL;
+
+/**
+ * Checks whether candidate a is better than candidate b
+ */
+#define KNN_BETTER(sa, ia, sb, ib) ((sa) > (sb) || ((sa) == (sb) && (ia) < (ib)))
+
+/**
+ * Adds a candidate to the heap of the best candidates. The worst
+ * candidate is kept at the root of the heap.
+ * @param w Workspace
+ * @param n Number of elements in heap
+ * @param id Candidate
+ * @param s Score of candidate
+ * @return number of elements in heap
+ */
+static int heap_add(knn_work_t *w, int n, unsigned long id, float s)
+{
+    unsigned long *hi = w->heap_id;
+    float *hs = w->heap_score;
+    int i, c;
+
+    if (n < knn) {
+        /* Sift up */
+        for (i = n++; i > 0 && KNN_BETTER(hs[(i - 1) / 2], hi[(i - 1) / 2],
+                                           s, id); i = (i - 1) / 2) {
+            hs[i] = hs[(i - 1) / 2];
+            hi[i] = hi[(i - 1) / 2];
+        }
+        hs[i] = s, hi[i] = id;
+        return n;
+    }
+
+    if (!KNN_BETTER(s, id, hs[0], hi[0]))
+        return n;
+
+    /* Sift down */
+    for (i = 0; (c = 2 * i + 1) < n; i = c) {
+        if (c + 1 < n && KNN_BETTER(hs[c], hi[c], hs[c + 1], hi[c + 1]))
+            c++;
+        if (!KNN_BETTER(s, id, hs[c], hi[c]))
+            break;
+        hs[i] = hs[c];
+        hi[i] = hi[c];
+    }
+    hs[i] = s, hi[i] = id;
+    return n;
+}
+
+/**
+ * Copies the candidates of the heap sorted by score. The heap holds
+ * at most k candidates, so a simple insertion sort is sufficient.
+ * @param w Workspace
+ * @param n Number of elements in heap
+ * @param id Sorted candidates
+ * @param score Sorted scores
+ */
+static void heap_sort(knn_work_t *w, int n, unsigned long *id, float *score)
+{
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        unsigned long hi = w->heap_id[i];
+        float hs = w->heap_score[i];
+        for (j = i; j > 0 && KNN_BETTER(hs, hi, score[j - 1], id[j - 1]); j--) {
+            score[j] = score[j - 1];
+            id[j] = id[j - 1];
+        }
+        score[j] = hs, id[j] = hi;
+    }
+}
+
+/**
+ * Compares terms by their maximum contribution (for qsort)
+ */
+static int cmp_bound(const void *x, const void *y)
+{
+    const knn_term_t *a = x, *b = y;
+    return (a->bound < b->bound) - (a->bound > b->bound);
+}
+
+/**
+ * Compares terms by their dimension (for qsort)
+ */
+static int cmp_dim(const void *x, const void *y)
+{
+    const knn_term_t *a = x, *b = y;
+    return (a->dim > b->dim) - (a->dim < b->dim);
+}
+
+/**
+ * Loads the reference set from a file of binary vectors
+ * @param fn File name
+ * @return 1 on success, 0 otherwise
+ */
+static int knn_load(const char *fn)
+{
+    unsigned long size = 1, i;
+    fvec_t *fv;
+    void *p;
+
+    gzFile z = gzopen(fn, "rb");
+    if (!z) {
+        error("Could not open reference file '%s'.", fn);
+        return FALSE;
+    }
+
+    zs = fzset_create();
+    labels = malloc(sizeof(float));
+    if (!zs || !labels) {
+        error("Could not allocate reference set");
+        gzclose(z);
+        return FALSE;
+    }
+
+    while ((fv = fvec_read_bin(z))) {
+        if (num + 1 > size) {
+            size *= 2;
+            if (!(p = realloc(labels, size * sizeof(float))))
+                goto err;
+            labels = p;
+        }
+
+        /* Normalize vectors for cosine similarity */
+        double s = 0;
+        for (i = 0; cosine && i < fv->len; i++)
+            s += (double) fv->val[i] * fv->val[i];
+        if (cosine && s > 0)
+            fvec_mul(fv, 1.0 / sqrt(s));
+
+        for (i = 0; i < fv->len; i++)
+            nonneg &= fv->val[i] >= 0;
+
+        if (!fzset_add(zs, fv)) {
+            fvec_destroy(fv);
+            gzclose(z);
+            return FALSE;
+        }
+        labels[num++] = fv->label;
+        fvec_destroy(fv);
+    }
+
+    /* Stop at damaged vectors instead of using a partial set */
+    if (!gzeof(z)) {
+        error("Could not read reference file '%s'.", fn);
+        gzclose(z);
+        return FALSE;
+    }
+
+    gzclose(z);
+    return TRUE;
+
+  err:
+    error("Could not allocate reference set");
+    fvec_destroy(fv);
+    gzclose(z);
+    return FALSE;
+}
+
+/**
+ * Determines the k nearest neighbors of a vector
+ * @param x Feature vector
+ * @param w Workspace
+ * @return number of neighbors
+ */
+static int knn_query(fvec_t *x, knn_work_t *w)
+{
+    unsigned long i, c, p, nc = 0, nt = 0, rt, scan = 0;
+    int n = 0, prune;
+    double rem = 0, s = 1, thres = -HUGE_VAL;
+    knn_term_t *t;
+
+    if (x->len > w->terms_size) {
+        free(w->terms);
+        free(w->rdim);
+        free(w->rval);
+        w->terms = malloc(x->len * sizeof(knn_term_t));
+        w->rdim = malloc(x->len * sizeof(feat_t));
+        w->rval = malloc(x->len * sizeof(float));
+        w->terms_size = x->len;
+        if (!w->terms || !w->rdim || !w->rval) {
+            error("Could not allocate query terms");
+            w->terms_size = 0;
+            return 0;
+        }
+    }
+
+    if (cosine) {
+        for (i = 0, s = 0; i < x->len; i++)
+            s += (double) x->val[i] * x->val[i];
+        s = s > 0 ? 1.0 / sqrt(s) : 1.0;
+    }
+
+    /* Collect terms present in the reference set */
+    prune = nonneg;
+    for (i = 0; i < x->len; i++) {
+        long u = findex_find(idx, x->dim[i]);
+        if (u < 0)
+            continue;
+        t = w->terms + nt++;
+        t->dim = x->dim[i];
+        t->post = u;
+        t->val = (float) (x->val[i] * s);
+        t->bound = fabs(t->val) * idx->max[u];
+        rem += t->bound;
+        prune &= t->val >= 0;
+    }
+    qsort(w->terms, nt, sizeof(knn_term_t), cmp_bound);
+
+    /* Accumulate scores of terms with the highest contribution */
+    for (rt = 0; rt < nt; rt++) {
+        t = w->terms + rt;
+
+        /*
+         * The k-th best partial score only grows, so an old value is a
+         * valid threshold. It is rebuilt once as many postings have been
+         * scanned as there are candidates, which amortizes its cost.
+         */
+        if (prune && nc >= (unsigned long) knn) {
+            if (scan >= nc) {
+                for (c = 0, n = 0; c < nc; c++)
+                    n = heap_add(w, n, w->cand[c], w->acc[w->cand[c]]);
+                thres = w->heap_score[0];
+                scan = 0;
+            }
+            if (rem < thres)
+                break;
+        }
+
+        scan += idx->start[t->post + 1] - idx->start[t->post];
+        for (p = idx->start[t->post]; p < idx->start[t->post + 1]; p++) {
+            unsigned long r = idx->row[p];
+            if (!w->mark[r]) {
+                w->mark[r] = TRUE;
+                w->cand[nc++] = r;
+            }
+            w->acc[r] += t->val * idx->val[p];
+        }
+        rem -= t->bound;
+    }
+
+    /* Add remaining terms to candidates */
+    if (rt < nt) {
+        fvec_t q;
+        fzvec_t ref;
+
+        qsort(w->terms + rt, nt - rt, sizeof(knn_term_t), cmp_dim);
+        memset(&q, 0, sizeof(fvec_t));
+        q.dim = w->rdim;
+        q.val = w->rval;
+        for (i = rt; i < nt; i++) {
+            q.dim[q.len] = w->terms[i].dim;
+            q.val[q.len++] = w->terms[i].val;
+        }
+
+        for (c = 0; c < nc; c++) {
+            unsigned long r = w->cand[c];
+            fzset_get(zs, r, &ref);
+            w->acc[r] += fzvec_dot(&ref, &q);
+        }
+    }
+
+    /* Select best candidates and reset workspace */
+    for (c = 0, n = 0; c < nc; c++) {
+        unsigned long r = w->cand[c];
+        n = heap_add(w, n, r, w->acc[r]);
+        w->acc[r] = 0;
+        w->mark[r] = FALSE;
+    }
+
+    return n;
+}
+
+/**
+ * Opens a file for writing nearest neighbors
+ * @param fn File name
+ * @return number of regular files
+ */
+int output_knn_open(char *fn)
+{
+    assert(fn);
+    const char *ref_file, *kernel;
+    cfg_int knn_num;
+    int i;
+
+    config_lookup_bool(&cfg, "output.skip_null", &skip_null);
+    config_lookup_string(&cfg, "output.knn_file", &ref_file);
+    config_lookup_int(&cfg, "output.knn_num", &knn_num);
+    config_lookup_string(&cfg, "output.knn_kernel", &kernel);
+
+    if (!strcasecmp(kernel, "dot")) {
+        cosine = FALSE;
+    } else if (!strcasecmp(kernel, "cosine")) {
+        cosine = TRUE;
+    } else {
+        warning("Unknown kNN kernel '%s', using 'dot'.", kernel);
+        cosine = FALSE;
+    }
+
+    knn = knn_num;
+    if (knn < 1) {
+        error("Number of nearest neighbors must be positive.");
+        return FALSE;
+    }
+
+    if (strlen(ref_file) == 0) {
+        error("No reference file for nearest neighbors given.");
+        return FALSE;
+    }
+
+    info_msg(1, "Loading reference set from '%s'.", ref_file);
+    if (!knn_load(ref_file))
+        return FALSE;
+
+    idx = findex_create(zs);
+    if (!idx)
+        return FALSE;
+
+    info_msg(1, "Indexed %lu reference vectors with %lu dimensions.",
+             num, idx->len);
+
+#ifdef HAVE_OPENMP
+    threads = omp_get_max_threads();
+#endif
+    work = calloc(threads, sizeof(knn_work_t));
+    if (!work) {
+        error("Could not allocate workspace");
+        return FALSE;
+    }
+
+    for (i = 0; i < threads; i++) {
+        work[i].acc = calloc(num + 1, sizeof(float));
+        work[i].mark = calloc(num + 1, sizeof(uint8_t));
+        work[i].cand = malloc((num + 1) * sizeof(unsigned long));
+        work[i].heap_id = malloc(knn * sizeof(unsigned long));
+        work[i].heap_score = malloc(knn * sizeof(float));
+        if (!work[i].acc || !work[i].mark || !work[i].cand ||
+            !work[i].heap_id || !work[i].heap_score) {
+            error("Could not allocate workspace");
+            return FALSE;
+        }
+    }
+
+    f = fopen(fn, "w");
+    if (!f) {
+        error("Could not open output file '%s'.", fn);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Writes a block of files to the output
+ * @param x Feature vectors
+ * @param len Length of block
+ * @return number of written files
+ */
+int output_knn_write(fvec_t **x, int len)
+{
+    assert(x && len >= 0);
+    unsigned long *res_id;
+    float *res_score;
+    int *res_num, i, j;
+
+    res_id = malloc(len * knn * sizeof(unsigned long) + 1);
+    res_score = malloc(len * knn * sizeof(float) + 1);
+    res_num = malloc(len * sizeof(int) + 1);
+    if (!res_id || !res_score || !res_num) {
+        error("Could not allocate nearest neighbors");
+        free(res_id);
+        free(res_score);
+        free(res_num);
+        return FALSE;
+    }
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (j = 0; j < len; j++) {
+#ifdef HAVE_OPENMP
+        knn_work_t *w = work + omp_get_thread_num();
+#else
+        knn_work_t *w = work;
+#endif
+        int n = knn_query(x[j], w);
+
+        res_num[j] = n;
+        heap_sort(w, n, res_id + j * knn, res_score + j * knn);
+    }
+
+    for (j = 0; j < len; j++) {
+        /* Skip null vectors */
+        if (skip_null && x[j]->len == 0)
+            continue;
+
+        for (i = 0; i < res_num[j]; i++) {
+            unsigned long r = res_id[j * knn + i];
+            fprintf(f, "%lu:%g:%g", r, labels[r], res_score[j * knn + i]);
+            if (i < res_num[j] - 1)
+                fprintf(f, ",");
+        }
+
+        /* Print source of string */
+        if (x[j]->src)
+            fprintf(f, " # %s", x[j]->src);
+
+        fprintf(f, "\n");
+    }
+
+    free(res_id);
+    free(res_score);
+    free(res_num);
+    return TRUE;
+}
+
+/**
+ * Closes an open output file.
+ */
+void output_knn_close()
+{
+    int i;
+
+    if (f)
+        fclose(f);
+
+    for (i = 0; work && i < threads; i++) {
+        free(work[i].acc);
+        free(work[i].mark);
+        free(work[i].cand);
+        free(work[i].terms);
+        free(work[i].rdim);
+        free(work[i].rval);
+        free(work[i].heap_id);
+        free(work[i].heap_score);
+    }
+
+    findex_destroy(idx);
+    free(work);
+    fzset_destroy(zs);
+    free(labels);
+
+    f = NULL;
+    work = NULL;
+    idx = NULL;
+    zs = NULL;
+    labels = NULL;
+    num = 0;
+    nonneg = TRUE;
+}
+
+/** @} */
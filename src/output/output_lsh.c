@@ -0,0 +1,340 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details. 
+ */
+
+/** 
+ * @addtogroup output
+ * <hr> 
+ * <em>lsh</em>: The vectors are not exported but indexed using
+ * locality-sensitive hashing. The bit signatures of reduced vectors
+ * are split into bands, which are hashed into bucket tables while the
+ * vectors are streamed. Vectors sharing a bucket in at least one band
+ * are candidate near-duplicates. Depending on the configuration, the
+ * candidate pairs are written in the form
+ * <pre> index index </pre>
+ * or the vectors are clustered by the connected components of the
+ * candidate pairs and written in the form
+ * <pre> index cluster </pre>
+ * Indices start at 0 and correspond to the order of the vectors. Labels
+ * and sources are written to a separate text file with the suffix
+ * ".meta", where line i corresponds to index i.
+ * @{
+ */
+
+#include "config.h"
+#include "common.h"
+#include "util.h"
+#include "output.h"
+#include "sally.h"
+#include "reduce.h"
+#include "fhash.h"
+
+/**
+ * Bucket of a band
+ */
+typedef struct
+{
+    uint64_t key;          /**< Hash of band */
+    uint32_t *ids;         /**< Indices of vectors */
+    uint32_t len;          /**< Number of vectors */
+    uint32_t size;         /**< Allocated number of vectors */
+    UT_hash_handle hh;     /**< Uthash handle */
+} bucket_t;
+
+/* External variables */
+extern config_t cfg;
+
+/* Local variables */
+static FILE *f = NULL;
+static FILE *m = NULL;
+static bucket_t *buckets = NULL;
+static uint8_t *buf = NULL;
+static uint32_t *cands = NULL;
+static uint32_t *parent = NULL;
+static uint32_t num = 0, parent_size = 0;
+static int bits = 0, bands = 0, rows = 0;
+static int clusters = FALSE;
+static int skip_null = CONFIG_FALSE;
+
+/**
+ * Finds the root of a vector in the union-find forest
+ * @param i Index of vector
+ * @return index of root
+ */
+static uint32_t uf_find(uint32_t i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/**
+ * Merges the clusters of two vectors. The smallest index is the root.
+ * @param i Index of vector
+ * @param j Index of vector
+ */
+static void uf_union(uint32_t i, uint32_t j)
+{
+    i = uf_find(i);
+    j = uf_find(j);
+
+    if (i < j)
+        parent[j] = i;
+    else if (j < i)
+        parent[i] = j;
+}
+
+/**
+ * Computes the hash of a band of the current signature
+ * @param b Index of band
+ * @return hash of band
+ */
+static uint64_t band_key(int b)
+{
+    uint64_t key = hash_mix(b + 1), w = 0;
+    int i, k;
+
+    for (i = 0; i < rows; i++) {
+        k = b * rows + i;
+        w |= (uint64_t) ((buf[k / 8] >> (k % 8)) & 1) << (i % 64);
+        if (i % 64 == 63 || i == rows - 1) {
+            key = hash_mix(key ^ w);
+            w = 0;
+        }
+    }
+
+    return key;
+}
+
+/**
+ * Compares two indices (for qsort)
+ * @param x Index
+ * @param y Index
+ * @return comparison
+ */
+static int cmp_id(const void *x, const void *y)
+{
+    uint32_t a = *(const uint32_t *) x, b = *(const uint32_t *) y;
+    return (a > b) - (a < b);
+}
+
+/**
+ * Adds the current signature to the buckets of all bands and collects
+ * the candidates of the vector.
+ * @param id Index of vector
+ * @return number of candidates
+ */
+static int lsh_insert(uint32_t id)
+{
+    bucket_t *e;
+    int b, n = 0;
+
+    for (b = 0; b < bands; b++) {
+        uint64_t key = band_key(b);
+
+        HASH_FIND(hh, buckets, &key, sizeof(uint64_t), e);
+        if (!e) {
+            e = calloc(1, sizeof(bucket_t));
+            if (!e) {
+                error("Could not allocate bucket");
+                return n;
+            }
+            e->key = key;
+            HASH_ADD(hh, buckets, key, sizeof(uint64_t), e);
+        }
+
+        /* Clusters only require the first vector of a bucket */
+        if (clusters && e->len > 0) {
+            uf_union(id, e->ids[0]);
+            continue;
+        }
+
+        if (e->len > 0) {
+            uint32_t *p = realloc(cands, (n + e->len) * sizeof(uint32_t));
+            if (!p) {
+                error("Could not allocate candidates");
+                return n;
+            }
+            cands = p;
+            memcpy(cands + n, e->ids, e->len * sizeof(uint32_t));
+            n += e->len;
+        }
+
+        if (e->len == e->size) {
+            uint32_t s = e->size ? 2 * e->size : 1;
+            uint32_t *p = realloc(e->ids, s * sizeof(uint32_t));
+            if (!p) {
+                error("Could not allocate bucket");
+                return n;
+            }
+            e->ids = p;
+            e->size = s;
+        }
+        e->ids[e->len++] = id;
+    }
+
+    return n;
+}
+
+/**
+ * Opens a file for writing LSH candidates
+ * @param fn File name
+ * @return number of regular files
+ */
+int output_lsh_open(char *fn)
+{
+    assert(fn);
+    char meta[MAX_PATH_LEN];
+    const char *method, *mode;
+    cfg_int dim_num, lsh_bands;
+
+    config_lookup_bool(&cfg, "output.skip_null", &skip_null);
+    config_lookup_string(&cfg, "filter.dim_reduce", &method);
+    config_lookup_int(&cfg, "filter.dim_num", &dim_num);
+    config_lookup_int(&cfg, "output.lsh_bands", &lsh_bands);
+    config_lookup_string(&cfg, "output.lsh_mode", &mode);
+
+    if (!strcasecmp(method, "none"))
+        warning("LSH requires a dimension reduction.");
+
+    if (!strcasecmp(mode, "pairs")) {
+        clusters = FALSE;
+    } else if (!strcasecmp(mode, "clusters")) {
+        clusters = TRUE;
+    } else {
+        warning("Unknown LSH mode '%s', using 'pairs'.", mode);
+        clusters = FALSE;
+    }
+
+    /* Similarity hashes may be shorter than requested */
+    bits = reduce_bits(dim_num);
+    bands = lsh_bands;
+    if (bands < 1 || bands > bits) {
+        error("Number of LSH bands must be between 1 and %d.", bits);
+        return FALSE;
+    }
+    rows = bits / bands;
+    if (bits % bands != 0)
+        warning("Ignoring last %d bits of signatures for LSH.", bits % bands);
+
+    buf = malloc((bits + 7) / 8 + 1);
+    if (!buf) {
+        error("Could not allocate signature buffer");
+        return FALSE;
+    }
+
+    f = fopen(fn, "w");
+    if (!f) {
+        error("Could not open output file '%s'.", fn);
+        return FALSE;
+    }
+
+    snprintf(meta, MAX_PATH_LEN, "%s.meta", fn);
+    m = fopen(meta, "w");
+    if (!m) {
+        error("Could not open output file '%s'.", meta);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Writes a block of files to the output
+ * @param x Feature vectors
+ * @param len Length of block
+ * @return number of written files
+ */
+int output_lsh_write(fvec_t **x, int len)
+{
+    assert(x && len >= 0);
+    int i, j, n;
+
+    for (j = 0; j < len; j++) {
+        /* Skip null vectors */
+        if (skip_null && x[j]->len == 0)
+            continue;
+
+        if (num == UINT32_MAX) {
+            error("Too many vectors for LSH index.");
+            return FALSE;
+        }
+
+        if (clusters && num == parent_size) {
+            uint32_t s = parent_size ? 2 * parent_size : 1024;
+            uint32_t *p = realloc(parent, s * sizeof(uint32_t));
+            if (!p) {
+                error("Could not allocate clusters");
+                return FALSE;
+            }
+            parent = p;
+            parent_size = s;
+        }
+        if (clusters)
+            parent[num] = num;
+
+        reduce_pack(x[j], buf, bits);
+        n = lsh_insert(num);
+
+        /* Print unique candidate pairs */
+        qsort(cands, n, sizeof(uint32_t), cmp_id);
+        for (i = 0; i < n; i++)
+            if (i == 0 || cands[i] != cands[i - 1])
+                fprintf(f, "%u %u\n", cands[i], num);
+
+        fprintf(m, "%g", x[j]->label);
+        if (x[j]->src)
+            fprintf(m, " %s", x[j]->src);
+        fprintf(m, "\n");
+
+        num++;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Closes an open output file.
+ */
+void output_lsh_close()
+{
+    bucket_t *e;
+    uint32_t i;
+
+    /* Print clusters */
+    if (clusters && f)
+        for (i = 0; i < num; i++)
+            fprintf(f, "%u %u\n", i, uf_find(i));
+
+    while (buckets) {
+        e = buckets;
+        HASH_DEL(buckets, e);
+        free(e->ids);
+        free(e);
+    }
+
+    if (f)
+        fclose(f);
+    if (m)
+        fclose(m);
+
+    free(buf);
+    free(cands);
+    free(parent);
+
+    f = m = NULL;
+    buf = NULL;
+    cands = parent = NULL;
+    num = parent_size = 0;
+}
+
+/** @} */
@@ -298,27 +298,28 @@ static int fwrite_fvec_feat(fvec_t *fv, FILE *f)
 
     /* Header */
     r += fwrite_array_flags(0, MAT_CLASS_CELL, 0, f);
-    if (fhash_enabled())
+    if (output_feat_enabled())
         r += fwrite_array_dim(1, fv->len, f);
     else
         r += fwrite_array_dim(1, 0, f);
     r += fwrite_array_name("feat", f);
 
     /* Features */
-    for (i = 0; fhash_enabled() && i < fv->len; i++) {
+    for (i = 0; output_feat_enabled() && i < fv->len; i++) {
 
-        fentry_t *fe = fhash_get(fv->dim[i]);
-        for (j = k = 0; fe && j < fe->len && k < 4096 - 5; j++) {
-            if (fe->data[j] == '%') {
+        int fl = 0;
+        char *fs = output_feat_get(fv->dim[i], &fl);
+        for (j = k = 0; fs && j < fl && k < 4096 - 5; j++) {
+            if (fs[j] == '%') {
                 /* Matlab requires that "%" is separately encoded as "%%" */
                 buf[k++] = '%';
                 buf[k++] = '%';
-            } else if (isprint(fe->data[j])) {
+            } else if (isprint(fs[j])) {
                 /* Printable characters */
-                buf[k++] = fe->data[j];
+                buf[k++] = fs[j];
             } else {
                 /* URI encoding of non-printable characters */
-                snprintf(buf + k, 4, "%%%.2x", (unsigned char) fe->data[j]);
+                snprintf(buf + k, 4, "%%%.2x", (unsigned char) fs[j]);
                 k += 3;
             }
         }
@@ -0,0 +1,230 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details. 
+ */
+
+/** 
+ * @addtogroup output
+ * <hr> 
+ * <em>matrix</em>: The vectors are not exported directly. Instead a
+ * matrix of pairwise dot products or cosine similarities is computed
+ * and stored in a binary file of the form
+ * <pre> rows cols value ... </pre>
+ * where rows and cols are 64-bit integers and the values are 32-bit
+ * floats in row-major order. The vectors are collected in a compressed
+ * sparse format and an inverted index over the dimensions is used to
+ * compute blocks of rows in parallel. Labels and sources are written
+ * to a separate text file with the suffix ".meta".
+ * @{
+ */
+
+#include "config.h"
+#include "common.h"
+#include "util.h"
+#include "output.h"
+#include "sally.h"
+#include "output_matrix.h"
+#include "findex.h"
+#include "fzvec.h"
+
+/* External variables */
+extern config_t cfg;
+
+/* Local variables */
+static FILE *f = NULL;
+static FILE *m = NULL;
+static int cosine = FALSE;
+static int skip_null = CONFIG_FALSE;
+
+/* Collected vectors */
+static fzset_t *zs = NULL;
+
+/**
+ * Opens a file for writing a similarity matrix
+ * @param fn File name
+ * @return number of regular files
+ */
+int output_matrix_open(char *fn)
+{
+    assert(fn);
+    char meta[MAX_PATH_LEN];
+    const char *kernel;
+
+    config_lookup_bool(&cfg, "output.skip_null", &skip_null);
+    config_lookup_string(&cfg, "output.matrix_kernel", &kernel);
+
+    if (!strcasecmp(kernel, "dot")) {
+        cosine = FALSE;
+    } else if (!strcasecmp(kernel, "cosine")) {
+        cosine = TRUE;
+    } else {
+        warning("Unknown matrix kernel '%s', using 'dot'.", kernel);
+        cosine = FALSE;
+    }
+
+    f = fopen(fn, "w");
+    if (!f) {
+        error("Could not open output file '%s'.", fn);
+        return FALSE;
+    }
+
+    snprintf(meta, MAX_PATH_LEN, "%s.meta", fn);
+    m = fopen(meta, "w");
+    if (!m) {
+        error("Could not open output file '%s'.", meta);
+        return FALSE;
+    }
+
+    zs = fzset_create();
+    if (!zs)
+        return FALSE;
+
+    return TRUE;
+}
+
+/**
+ * Collects a block of vectors. The matrix is computed once all vectors
+ * have been collected.
+ * @param x Feature vectors
+ * @param len Length of block
+ * @return number of written files
+ */
+int output_matrix_write(fvec_t **x, int len)
+{
+    assert(x && len >= 0);
+    int j;
+
+    for (j = 0; j < len; j++) {
+        /* Skip null vectors */
+        if (skip_null && x[j]->len == 0)
+            continue;
+
+        if (!fzset_add(zs, x[j]))
+            return FALSE;
+
+        fprintf(m, "%g", x[j]->label);
+        if (x[j]->src)
+            fprintf(m, " %s", x[j]->src);
+        fprintf(m, "\n");
+    }
+
+    return TRUE;
+}
+
+/**
+ * Computes the matrix using an inverted index and writes it block-wise.
+ * Each block of rows is computed in parallel, where every row is
+ * accumulated by scattering the postings of its dimensions.
+ */
+static void matrix_compute()
+{
+    unsigned long *pos, i, k, r0, r1, block;
+    unsigned long num = zs->num, *rows = zs->pos;
+    float *norm, *buf, *vals = zs->val;
+    uint64_t hdr[2] = { num, num };
+    findex_t *idx;
+    feat_t *dim;
+    fzvec_t zv;
+
+    idx = findex_create(zs);
+    pos = malloc(fzset_nnz(zs) * sizeof(unsigned long) + 1);
+    norm = malloc(num * sizeof(float) + 1);
+    dim = malloc(zs->max * sizeof(feat_t) + 1);
+
+    /* Rows per block such that a block fits the tile size */
+    block = num > 0 ? MATRIX_TILE / num : 1;
+    if (block == 0)
+        block = 1;
+    buf = malloc(block * num * sizeof(float) + 1);
+
+    if (!idx || !pos || !norm || !buf || !dim) {
+        error("Could not allocate inverted index");
+        goto out;
+    }
+
+    /* Postings and norms of rows */
+    for (i = 0; i < num; i++) {
+        double s = 0;
+        fzset_get(zs, i, &zv);
+        fzvec_decode(dim, zv.dim, zv.len);
+        for (k = rows[i]; k < rows[i + 1]; k++) {
+            pos[k] = findex_find(idx, dim[k - rows[i]]);
+            s += (double) vals[k] * vals[k];
+        }
+        norm[i] = (float) sqrt(s);
+    }
+
+    if (fwrite(hdr, sizeof(uint64_t), 2, f) != 2)
+        error("Could not write matrix header");
+
+    info_msg(1, "Computing %lu x %lu matrix in blocks of %lu rows.",
+             num, num, block);
+
+    for (r0 = 0; r0 < num; r0 = r1) {
+        r1 = r0 + block < num ? r0 + block : num;
+        long ri;
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic, 4) private(k)
+#endif
+        for (ri = r0; ri < r1; ri++) {
+            float *row = buf + (ri - r0) * num;
+            unsigned long p, j;
+
+            memset(row, 0, num * sizeof(float));
+            for (k = rows[ri]; k < rows[ri + 1]; k++) {
+                float v = vals[k];
+                unsigned long e = idx->start[pos[k] + 1];
+                for (p = idx->start[pos[k]]; p < e; p++)
+                    row[idx->row[p]] += v * idx->val[p];
+            }
+
+            if (!cosine)
+                continue;
+            for (j = 0; j < num; j++)
+                if (norm[ri] > 0 && norm[j] > 0)
+                    row[j] /= norm[ri] * norm[j];
+        }
+
+        if (fwrite(buf, sizeof(float), (r1 - r0) * num, f) !=
+            (r1 - r0) * num) {
+            error("Could not write matrix to output file");
+            break;
+        }
+        prog_bar(0, num, r1);
+    }
+
+  out:
+    findex_destroy(idx);
+    free(pos);
+    free(norm);
+    free(buf);
+    free(dim);
+}
+
+/**
+ * Computes the matrix and closes the output file.
+ */
+void output_matrix_close()
+{
+    if (f && zs)
+        matrix_compute();
+
+    if (f)
+        fclose(f);
+    if (m)
+        fclose(m);
+
+    fzset_destroy(zs);
+
+    f = m = NULL;
+    zs = NULL;
+}
+
+/** @} */
@@ -0,0 +1,23 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details. 
+ */
+
+#ifndef OUTPUT_MATRIX_H
+#define OUTPUT_MATRIX_H
+
+/** Number of matrix entries computed per block (16 MB) */
+#define MATRIX_TILE     (1 << 22)
+
+/* Matrix output module */
+int output_matrix_open(char *);
+int output_matrix_write(fvec_t **, int);
+void output_matrix_close(void);
+
+#endif /* OUTPUT_MATRIX_H */
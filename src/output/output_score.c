@@ -0,0 +1,135 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details. 
+ */
+
+/** 
+ * @addtogroup output
+ * <hr> 
+ * <em>score</em>: The vectors are not exported directly. Instead each
+ * vector is scored by a linear model, that is, the dot product with a
+ * weight vector plus a bias, and written as a text line of the form
+ * <pre> label score # source </pre>
+ * The weight vector is loaded from a file in the format of fvec_save().
+ * @{
+ */
+
+#include "config.h"
+#include "common.h"
+#include "util.h"
+#include "output.h"
+#include "sally.h"
+#include "fmath.h"
+
+/* External variables */
+extern config_t cfg;
+
+/* Local variables */
+static FILE *f = NULL;
+static int skip_null = CONFIG_FALSE;
+static fvec_t *model = NULL;
+static double bias = 0;
+
+/**
+ * Opens a file for writing scores and loads the linear model
+ * @param fn File name
+ * @return number of regular files
+ */
+int output_score_open(char *fn)
+{
+    assert(fn);
+    const char *model_file;
+
+    config_lookup_bool(&cfg, "output.skip_null", &skip_null);
+    config_lookup_string(&cfg, "output.score_model", &model_file);
+    config_lookup_float(&cfg, "output.score_bias", &bias);
+
+    if (strlen(model_file) == 0) {
+        error("No linear model given for scoring.");
+        return FALSE;
+    }
+
+    model = fvec_load((char *) model_file);
+    if (!model) {
+        error("Could not load linear model '%s'.", model_file);
+        return FALSE;
+    }
+    info_msg(1, "Loaded linear model with %lu weights from '%s'.",
+             model->len, model_file);
+
+    f = fopen(fn, "w");
+    if (!f) {
+        error("Could not open output file '%s'.", fn);
+        fvec_destroy(model);
+        model = NULL;
+        return FALSE;
+    }
+
+    /* Write sally header */
+    sally_version(f, "# ", "Output module for scores of linear model");
+
+    return TRUE;
+}
+
+/**
+ * Writes a block of files to the output
+ * @param x Feature vectors
+ * @param len Length of block
+ * @return number of written files
+ */
+int output_score_write(fvec_t **x, int len)
+{
+    assert(x && len >= 0);
+    double *score;
+    int j;
+
+    score = malloc(len * sizeof(double) + 1);
+    if (!score) {
+        error("Could not allocate scores");
+        return FALSE;
+    }
+
+    /* Score vectors in parallel */
+#ifdef HAVE_OPENMP
+#pragma omp parallel for
+#endif
+    for (j = 0; j < len; j++)
+        score[j] = fvec_dot(x[j], model) + bias;
+
+    for (j = 0; j < len; j++) {
+        /* Skip null vectors */
+        if (skip_null && x[j]->len == 0)
+            continue;
+
+        fprintf(f, "%g %g", x[j]->label, score[j]);
+
+        /* Print source of string */
+        if (x[j]->src)
+            fprintf(f, " # %s", x[j]->src);
+
+        fprintf(f, "\n");
+    }
+
+    free(score);
+    return TRUE;
+}
+
+/**
+ * Closes an open output file.
+ */
+void output_score_close()
+{
+    if (f)
+        fclose(f);
+
+    fvec_destroy(model);
+    model = NULL;
+}
+
+/** @} */
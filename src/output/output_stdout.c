@@ -74,14 +74,15 @@ int output_stdout_write(fvec_t **x, int len)
 
         for (i = 0; i < x[j]->len; i++) {
             /* Print feature (hash and string) */
-            fentry_t *fe = fhash_get(x[j]->dim[i]);
+            int fl = 0;
+            char *fs = output_feat_get(x[j]->dim[i], &fl);
             fprintf(stdout, "%llu:",
                     (long long unsigned int) x[j]->dim[i] + 1);
-            for (k = 0; fe && k < fe->len; k++) {
-                if (isprint(fe->data[k]) && !strchr("%:, ", fe->data[k]))
-                    fprintf(stdout, "%c", fe->data[k]);
+            for (k = 0; fs && k < fl; k++) {
+                if (isprint(fs[k]) && !strchr("%:, ", fs[k]))
+                    fprintf(stdout, "%c", fs[k]);
                 else
-                    fprintf(stdout, "%%%.2x", (unsigned char) fe->data[k]);
+                    fprintf(stdout, "%%%.2x", (unsigned char) fs[k]);
             }
 
             /* Print value of feature */
@@ -76,13 +76,14 @@ int output_text_write(fvec_t **x, int len)
 
         for (i = 0; i < x[j]->len; i++) {
             /* Print feature (hash and string) */
-            fentry_t *fe = fhash_get(x[j]->dim[i]);
+            int fl = 0;
+            char *fs = output_feat_get(x[j]->dim[i], &fl);
             fprintf(f, "%llu:", (long long unsigned int) x[j]->dim[i] + 1);
-            for (k = 0; fe && k < fe->len; k++) {
-                if (isprint(fe->data[k]) && !strchr("%:, ", fe->data[k]))
-                    fprintf(f, "%c", fe->data[k]);
+            for (k = 0; fs && k < fl; k++) {
+                if (isprint(fs[k]) && !strchr("%:, ", fs[k]))
+                    fprintf(f, "%c", fs[k]);
                 else
-                    fprintf(f, "%%%.2x", (unsigned char) fe->data[k]);
+                    fprintf(f, "%%%.2x", (unsigned char) fs[k]);
             }
 
             /* Print value of feature */
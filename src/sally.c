@@ -18,6 +18,12 @@
 #include "fvec.h"
 #include "util.h"
 #include "reduce.h"
+#include "vocab.h"
+#include "fdict.h"
+#include "fselect.h"
+#include "fgroup.h"
+#include "fwindow.h"
+#include "fpca.h"
 #include "sconfig.h"
 
 /* Global variables */
@@ -29,6 +35,7 @@ config_t cfg;
 static char *input = NULL;
 static char *output = NULL;
 static long entries = 0;
+static int tfidf_spill = FALSE;
 
 /* Option string */
 #define OPTSTRING       "g:c:i:o:n:m:r:d:psBSXE:N:b:kvqVhCD"
@@ -49,12 +56,13 @@ static struct option longopts[] = {
     {"granularity", 1, NULL, 'g'},
     {"token_delim", 1, NULL, 'd'},
     {"ngram_pos", 0, NULL, 'p'},
-    {"pos_shift", 1, NULL, 1012},       /* <- last entry */
+    {"pos_shift", 1, NULL, 1012},
     {"ngram_blend", 0, NULL, 'B'},
     {"ngram_sort", 0, NULL, 's'},
     {"vect_embed", 1, NULL, 'E'},
     {"vect_norm", 1, NULL, 'N'},
     {"vect_sign", 0, NULL, 'S'},
+    {"vect_enc", 1, NULL, 1016},
     {"thres_low", 1, NULL, 1009},
     {"thres_high", 1, NULL, 1010},
     {"hash_bits", 1, NULL, 'b'},
@@ -63,6 +71,21 @@ static struct option longopts[] = {
     {"dim_reduce", 1, NULL, 'r'},
     {"dim_num", 1, NULL, 'm'},
     {"tfidf_file", 1, NULL, 1004},
+    {"tfidf_spill", 0, NULL, 1013},
+    {"tfidf_update", 0, NULL, 1014},
+    {"tfidf_merge", 1, NULL, 1015},
+    {"vocab_file", 1, NULL, 1017},
+    {"vocab_size", 1, NULL, 1018},
+    {"dict_file", 1, NULL, 1019},
+    {"select_file", 1, NULL, 1020},
+    {"select_method", 1, NULL, 1021},
+    {"select_num", 1, NULL, 1022},
+    {"group_regex", 1, NULL, 1023},
+    {"group_source", 0, NULL, 1024},
+    {"group_window", 1, NULL, 1025},
+    {"window_len", 1, NULL, 1026},
+    {"window_stride", 1, NULL, 1027},
+    {"pca_file", 1, NULL, 1028},        /* <- last entry */
     {"output_format", 1, NULL, 'o'},
     {"skip_null", 0, NULL, 'k'},
     {"verbose", 0, NULL, 'v'},
@@ -123,15 +146,31 @@ static void print_usage(void)
            "  -E,  --vect_embed <embed>      Set embedding mode for vectors.\n"
            "  -N,  --vect_norm <norm>        Set normalization mode for vectors.\n"
            "  -S,  --vect_sign               Enable signed embedding.\n"
+           "       --vect_enc <enc>          Set encoding of vector values.\n"
            "       --thres_low <float>       Enable minimum threshold for vectors.\n"
            "       --thres_high <float>      Enable maximum threshold for vectors.\n"
            "  -b,  --hash_bits <num>         Set number of hash bits.\n"
            "  -X,  --explicit_hash           Enable explicit hash table.\n"
            "       --hash_file <file>        Set file name for explicit hash table.\n"
            "       --tfidf_file <file>       Set file name for TFIDF weighting.\n"
+           "       --tfidf_spill             Compute TFIDF weighting in one pass.\n"
+           "       --tfidf_update            Update TFIDF weighting with input.\n"
+           "       --tfidf_merge <files>     Merge document frequencies from files.\n"
+           "       --vocab_file <file>       Set file name for vocabulary.\n"
+           "       --vocab_size <num>        Set number of features in vocabulary.\n"
+           "       --dict_file <file>        Set file name for dictionary of features.\n"
+           "       --select_file <file>      Set file name for selected features.\n"
+           "       --select_method <name>    Set score for feature selection.\n"
+           "       --select_num <num>        Set number of selected features.\n"
+           "       --window_len <num>        Set length of sliding windows.\n"
+           "       --window_stride <num>     Set stride of sliding windows.\n"
            "\nFilter options:\n"
            "  -r,  --dim_reduce <method>     Set method for dimension reduction.\n"
            "  -m,  --dim_num <num>           Set number of dimensions to keep.\n"
+           "       --group_regex <regex>     Set regex for key of aggregation.\n"
+           "       --group_source            Match group key against source.\n"
+           "       --group_window <num>      Set number of strings per window.\n"
+           "       --pca_file <file>         Set file name for principal components.\n"
            "\nGeneric options:\n"
            "  -c,  --config_file <file>      Set configuration file.\n"
            "  -v,  --verbose                 Increase verbosity.\n"
@@ -205,6 +244,54 @@ static void sally_parse_options(int argc, char **argv)
         case 1012:
             config_set_int(&cfg, "features.pos_shift", atoi(optarg));
             break;
+        case 1013:
+            config_set_bool(&cfg, "features.tfidf_spill", CONFIG_TRUE);
+            break;
+        case 1014:
+            config_set_bool(&cfg, "features.tfidf_update", CONFIG_TRUE);
+            break;
+        case 1015:
+            config_set_string(&cfg, "features.tfidf_merge", optarg);
+            break;
+        case 1016:
+            config_set_string(&cfg, "features.vect_enc", optarg);
+            break;
+        case 1017:
+            config_set_string(&cfg, "features.vocab_file", optarg);
+            break;
+        case 1018:
+            config_set_int(&cfg, "features.vocab_size", atoi(optarg));
+            break;
+        case 1019:
+            config_set_string(&cfg, "features.dict_file", optarg);
+            break;
+        case 1020:
+            config_set_string(&cfg, "features.select_file", optarg);
+            break;
+        case 1021:
+            config_set_string(&cfg, "features.select_method", optarg);
+            break;
+        case 1022:
+            config_set_int(&cfg, "features.select_num", atoi(optarg));
+            break;
+        case 1023:
+            config_set_string(&cfg, "filter.group_regex", optarg);
+            break;
+        case 1024:
+            config_set_bool(&cfg, "filter.group_source", CONFIG_TRUE);
+            break;
+        case 1025:
+            config_set_int(&cfg, "filter.group_window", atoi(optarg));
+            break;
+        case 1026:
+            config_set_int(&cfg, "features.window_len", atoi(optarg));
+            break;
+        case 1027:
+            config_set_int(&cfg, "features.window_stride", atoi(optarg));
+            break;
+        case 1028:
+            config_set_string(&cfg, "filter.pca_file", optarg);
+            break;
         case 'r':
             config_set_string(&cfg, "filter.dim_reduce", optarg);
             break;
@@ -378,27 +465,71 @@ static void sally_load_config(int argc, char **argv)
  */
 static void sally_init()
 {
-    int ehash;
+    int ehash, spill;
     const char *cfg_str;
 
     if (verbose > 1)
         config_print(&cfg);
 
+    /* Seeds are shared by all threads and filled up front */
+    rehash_init();
+
     /* Set delimiters */
     config_lookup_string(&cfg, "features.token_delim", &cfg_str);
     if (strlen(cfg_str) > 0)
         fvec_delim_set(cfg_str);
 
-    /* Check for TFIDF weighting */
-    config_lookup_string(&cfg, "features.vect_embed", &cfg_str);
-    if (!strcasecmp(cfg_str, "tfidf"))
-        idf_create(input);
-
     /* Load stop tokens */
     config_lookup_string(&cfg, "input.stoptoken_file", &cfg_str);
     if (strlen(cfg_str) > 0)
         stoptokens_load(cfg_str);
 
+    /* Check for sliding windows */
+    fwindow_init();
+    if (fwindow_enabled())
+        info_msg(1, "Enabling embedding of sliding windows.");
+
+    /* Check for dictionary of features */
+    config_lookup_string(&cfg, "features.dict_file", &cfg_str);
+    if (strlen(cfg_str) > 0) {
+        info_msg(1, "Enabling dictionary of features.");
+        fdict_init(cfg_str);
+    }
+
+    /* Check for vocabulary */
+    config_lookup_string(&cfg, "features.vocab_file", &cfg_str);
+    if (strlen(cfg_str) > 0)
+        vocab_create(input);
+
+    /* Check for feature selection */
+    config_lookup_string(&cfg, "features.select_file", &cfg_str);
+    if (strlen(cfg_str) > 0)
+        fselect_create(input);
+
+    /* Check for TFIDF weighting */
+    config_lookup_string(&cfg, "features.vect_embed", &cfg_str);
+    if (!strcasecmp(cfg_str, "tfidf")) {
+        config_lookup_bool(&cfg, "features.tfidf_spill", &spill);
+        config_lookup_string(&cfg, "input.input_format", &cfg_str);
+
+        /* Standard input can only be read once */
+        if (!strcasecmp(cfg_str, "stdin"))
+            spill = TRUE;
+
+        /* Principal components need the weights in a pre-pass */
+        if (spill && !fpca_learn() && idf_count_input()) {
+            info_msg(1, "Computing IDF weights in one pass using spill file.");
+            tfidf_spill = TRUE;
+        } else {
+            idf_create(input);
+        }
+    }
+
+    /* Check for principal components */
+    config_lookup_string(&cfg, "filter.dim_reduce", &cfg_str);
+    if (!strcasecmp(cfg_str, "pca"))
+        fpca_create(input);
+
     /* Check for feature hash table */
     config_lookup_bool(&cfg, "features.explicit_hash", &ehash);
     config_lookup_string(&cfg, "features.hash_file", &cfg_str);
@@ -407,6 +538,18 @@ static void sally_init()
         fhash_init();
     }
 
+    /* Check for aggregation of vectors */
+    config_lookup_string(&cfg, "filter.group_regex", &cfg_str);
+    if (strlen(cfg_str) > 0) {
+        info_msg(1, "Aggregating vectors by group key.");
+        fgroup_init(cfg_str);
+    }
+
+    /* Check for fused extraction and reduction */
+    reduce_init();
+    if (reduce_fused())
+        info_msg(1, "Fusing feature extraction and dimension reduction.");
+
     /* Open input */
     config_lookup_string(&cfg, "input.input_format", &cfg_str);
     input_config(cfg_str);
@@ -423,25 +566,117 @@ static void sally_init()
         fatal("Could not open output destination");
 }
 
+/**
+ * Writes the aggregated vectors of all groups to the output.
+ */
+static void sally_flush_groups()
+{
+    long num;
+    fvec_t **x = fgroup_flush(&num);
+
+    if (!output_write(x, num))
+        fatal("Failed to write vectors to output '%s'", output);
+
+    output_free(x, num);
+    free(x);
+}
+
+/**
+ * Extracts feature vectors from sliding windows over a chunk of
+ * strings. Each string yields one vector per stride, such that the
+ * array of vectors is enlarged if necessary. The vectors inherit label
+ * and source of their string.
+ * @param strs Array of strings
+ * @param read Number of strings
+ * @param fvec Pointer to array of vectors
+ * @param size Pointer to size of array
+ * @param post Post-process, reduce and aggregate vectors
+ * @return number of vectors
+ */
+static long sally_windows(string_t *strs, long read, fvec_t ***fvec,
+                          long *size, int post)
+{
+    long j, k, num = 0;
+    fvec_t ***wins = malloc(sizeof(fvec_t **) * read);
+    long *wlen = malloc(sizeof(long) * read);
+
+    if (!wins || !wlen)
+        fatal("Could not allocate memory for sliding windows");
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for private(k)
+#endif
+    for (j = 0; j < read; j++) {
+        char *src = strs[j].src;
+
+        /* Feature extraction of windows */
+        wins[j] = fwindow_extract(strs[j].str, strs[j].len, &wlen[j]);
+
+        /* Group key replaces source */
+        if (fgroup_enabled())
+            src = fgroup_key(strs[j].str, strs[j].len, strs[j].src);
+
+        for (k = 0; k < wlen[j]; k++) {
+            fvec_set_label(wins[j][k], strs[j].label);
+            fvec_set_source(wins[j][k], src);
+            if (!post)
+                continue;
+
+            /* Post-processing and dimension reduction */
+            fvec_postprocess(wins[j][k]);
+            dim_reduce(wins[j][k]);
+
+            /* Aggregation by group */
+            if (fgroup_enabled())
+                fgroup_add(wins[j][k]);
+        }
+
+        if (fgroup_enabled())
+            free(src);
+    }
+
+    for (j = 0; j < read; j++)
+        num += wlen[j];
+
+    if (num > *size) {
+        *fvec = realloc(*fvec, sizeof(fvec_t *) * num);
+        if (!*fvec)
+            fatal("Could not allocate memory for sliding windows");
+        *size = num;
+    }
+
+    for (j = 0, num = 0; j < read; j++) {
+        for (k = 0; k < wlen[j]; k++)
+            (*fvec)[num++] = wins[j][k];
+        free(wins[j]);
+    }
+
+    free(wins);
+    free(wlen);
+    return num;
+}
+
 /**
  * Main processing routine of Sally. This function processes chunks of
  * strings. It might be suitable for OpenMP support in a later version.
  */
 static void sally_process()
 {
-    long read, i, j;
-    cfg_int chunk;
+    long read, num, size, i, j, last = 0;
+    cfg_int chunk, window;
     const char *hash_file;
 
     /* Check if a hash file is set */
     config_lookup_string(&cfg, "features.hash_file", &hash_file);
 
-    /* Get chunk size */
+    /* Get chunk size and window of groups */
     config_lookup_int(&cfg, "input.chunk_size", &chunk);
+    config_lookup_int(&cfg, "filter.group_window", &window);
 
     /* Allocate space */
     fvec_t **fvec = malloc(sizeof(fvec_t *) * chunk);
     string_t *strs = malloc(sizeof(string_t) * chunk);
+    size = chunk;
 
     if (!fvec || !strs)
         fatal("Could not allocate memory for embedding");
@@ -459,34 +694,204 @@ static void sally_process()
         /* Generic preprocessing of input */
         input_preproc(strs, read);
 
+        /* Feature extraction of strings or sliding windows */
+        if (fwindow_enabled()) {
+            num = sally_windows(strs, read, &fvec, &size, TRUE);
+        } else {
+            num = read;
 #ifdef HAVE_OPENMP
 #pragma omp parallel for
 #endif
-        for (j = 0; j < read; j++) {
-            /* Feature extraction */
-            fvec[j] = fvec_extract(strs[j].str, strs[j].len);
-            fvec_set_label(fvec[j], strs[j].label);
-            fvec_set_source(fvec[j], strs[j].src);
-
-            /* Dimension reduction */
-            dim_reduce(fvec[j]);
+            for (j = 0; j < read; j++) {
+                /* Feature extraction (fused with reduction if possible) */
+                if (reduce_fused())
+                    fvec[j] = reduce_extract(strs[j].str, strs[j].len);
+                else
+                    fvec[j] = fvec_extract(strs[j].str, strs[j].len);
+                fvec_set_label(fvec[j], strs[j].label);
+
+                /* Group key replaces source */
+                if (fgroup_enabled())
+                    fvec[j]->src = fgroup_key(strs[j].str, strs[j].len,
+                                              strs[j].src);
+                else
+                    fvec_set_source(fvec[j], strs[j].src);
+
+                /* Dimension reduction */
+                if (!reduce_fused())
+                    dim_reduce(fvec[j]);
+
+                /* Aggregation by group */
+                if (fgroup_enabled())
+                    fgroup_add(fvec[j]);
+            }
         }
 
-        if (!output_write(fvec, read))
+        if (fgroup_enabled()) {
+            /* Flush groups at the end of a window */
+            if (window > 0 && i + read - last >= window) {
+                sally_flush_groups();
+                last = i + read;
+            }
+        } else if (!output_write(fvec, num)) {
             fatal("Failed to write vectors to output '%s'", output);
+        }
 
         /* Free memory */
         input_free(strs, read);
-        output_free(fvec, read);
+        output_free(fvec, num);
 
         /* Reset hash if enabled but no hash file is set */
-        if (fhash_enabled() && strlen(hash_file) == 0)
+        if (fhash_enabled() && strlen(hash_file) == 0 && !fgroup_enabled())
             fhash_reset();
 
         if (entries > 0)
             prog_bar(0, entries, i + read);
     }
 
+    if (fgroup_enabled())
+        sally_flush_groups();
+
+    free(fvec);
+    free(strs);
+}
+
+/**
+ * Processing routine of Sally for single-pass TFIDF weighting. In a
+ * first pass, the strings are read, extracted and spilled to a
+ * temporary file while the document frequencies are accumulated. In a
+ * second pass, the spilled vectors are weighted, post-processed and
+ * written to the output. The second pass reads the vectors in the same
+ * chunks as the strings, such that windows of groups count strings in
+ * both routines.
+ */
+static void sally_process_spill()
+{
+    long read, num, size, spilled = 0, i, j, k, c, last = 0;
+    long *cnum = NULL, *cread = NULL, chunks = 0, csize = 0;
+    cfg_int chunk, window;
+    void *p;
+
+    /* Get chunk size and window of groups */
+    config_lookup_int(&cfg, "input.chunk_size", &chunk);
+    config_lookup_int(&cfg, "filter.group_window", &window);
+
+    /* Allocate space */
+    fvec_t **fvec = malloc(sizeof(fvec_t *) * chunk);
+    string_t *strs = malloc(sizeof(string_t) * chunk);
+    size = chunk;
+
+    if (!fvec || !strs)
+        fatal("Could not allocate memory for embedding");
+
+    if (!idf_spill_open())
+        fatal("Could not open spill file for TFIDF weighting");
+
+    info_msg(1, "Spilling strings in chunks of %d.", chunk);
+
+    for (i = 0, read = 0; TRUE; i += read) {
+        read = input_read(strs, chunk);
+        if (read == 0)
+            break;
+
+        if (read < 0)
+            fatal("Failed to read strings from input '%s'", input);
+
+        /* Generic preprocessing of input */
+        input_preproc(strs, read);
+
+        /* Feature extraction of strings or sliding windows */
+        if (fwindow_enabled()) {
+            num = sally_windows(strs, read, &fvec, &size, FALSE);
+        } else {
+            num = read;
+#ifdef HAVE_OPENMP
+#pragma omp parallel for
+#endif
+            for (j = 0; j < read; j++) {
+                /* Feature extraction without post-processing */
+                fvec[j] = fvec_extract_intern(strs[j].str, strs[j].len);
+                fvec_set_label(fvec[j], strs[j].label);
+
+                /* Group key replaces source */
+                if (fgroup_enabled())
+                    fvec[j]->src = fgroup_key(strs[j].str, strs[j].len,
+                                              strs[j].src);
+                else
+                    fvec_set_source(fvec[j], strs[j].src);
+            }
+        }
+
+        if (!idf_spill_write(fvec, num))
+            fatal("Failed to spill vectors");
+        spilled += num;
+
+        /* Remember number of strings and vectors of chunk */
+        if (chunks == csize) {
+            csize = csize ? 2 * csize : 64;
+            if (!(p = realloc(cnum, csize * sizeof(long))))
+                fatal("Could not allocate memory for spilled chunks");
+            cnum = p;
+            if (!(p = realloc(cread, csize * sizeof(long))))
+                fatal("Could not allocate memory for spilled chunks");
+            cread = p;
+        }
+        cnum[chunks] = num;
+        cread[chunks++] = read;
+
+        /* Free memory */
+        input_free(strs, read);
+        output_free(fvec, num);
+
+        if (entries > 0)
+            prog_bar(0, entries, i + read);
+    }
+
+    if (!idf_spill_rewind(spilled))
+        fatal("Could not rewind spill file for TFIDF weighting");
+
+    info_msg(1, "Processing spilled vectors in chunks of %d.", chunk);
+
+    for (c = 0, i = 0, k = 0; c < chunks; c++) {
+        read = idf_spill_read(fvec, cnum[c]);
+        if (read != cnum[c])
+            fatal("Failed to read spilled vectors");
+
+#ifdef HAVE_OPENMP
+#pragma omp parallel for
+#endif
+        for (j = 0; j < read; j++) {
+            /* Post-processing and dimension reduction */
+            fvec_postprocess(fvec[j]);
+            dim_reduce(fvec[j]);
+
+            /* Aggregation by group */
+            if (fgroup_enabled())
+                fgroup_add(fvec[j]);
+        }
+
+        if (fgroup_enabled()) {
+            /* Flush groups at the end of a window */
+            if (window > 0 && i + cread[c] - last >= window) {
+                sally_flush_groups();
+                last = i + cread[c];
+            }
+        } else if (!output_write(fvec, read)) {
+            fatal("Failed to write vectors to output '%s'", output);
+        }
+
+        output_free(fvec, read);
+        i += cread[c];
+        k += read;
+        prog_bar(0, spilled, k);
+    }
+
+    if (fgroup_enabled())
+        sally_flush_groups();
+
+    idf_spill_close();
+    free(cnum);
+    free(cread);
     free(fvec);
     free(strs);
 }
@@ -511,6 +916,12 @@ static void sally_exit()
     if (strlen(cfg_str) > 0)
         stoptokens_destroy();
 
+    vocab_destroy();
+    fselect_destroy();
+    fgroup_destroy();
+    fpca_destroy();
+    fdict_destroy();
+
     config_lookup_string(&cfg, "features.hash_file", &hash_file);
     if (strlen(hash_file) > 0) {
         info_msg(1, "Saving explicit hash table to '%s'.", hash_file);
@@ -542,7 +953,10 @@ int main(int argc, char **argv)
     sally_parse_options(argc, argv);
 
     sally_init();
-    sally_process();
+    if (tfidf_spill)
+        sally_process_spill();
+    else
+        sally_process();
     sally_exit();
 
     return EXIT_SUCCESS;
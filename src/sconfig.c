@@ -22,6 +22,7 @@
 #include "util.h"
 #include "sconfig.h"
 #include "sally.h"
+#include "fvec.h"
 
 /* External variables */
 extern int verbose;
@@ -45,17 +46,44 @@ static config_default_t defaults[] = {
     {"features", "vect_embed", CONFIG_TYPE_STRING, {.str = "cnt"}},
     {"features", "vect_norm", CONFIG_TYPE_STRING, {.str = "none"}},
     {"features", "vect_sign", CONFIG_TYPE_BOOL, {.num = CONFIG_FALSE}},
+    {"features", "vect_enc", CONFIG_TYPE_STRING, {.str = "auto"}},
     {"features", "thres_low", CONFIG_TYPE_FLOAT, {.flt = 0}},
     {"features", "thres_high", CONFIG_TYPE_FLOAT, {.flt = 0}},
     {"features", "hash_bits", CONFIG_TYPE_INT, {.num = 22}},
     {"features", "explicit_hash", CONFIG_TYPE_BOOL, {.num = CONFIG_FALSE}},
     {"features", "hash_file", CONFIG_TYPE_STRING, {.str = ""}},
     {"features", "tfidf_file", CONFIG_TYPE_STRING, {.str = "tfidf.fv"}},
+    {"features", "tfidf_spill", CONFIG_TYPE_BOOL, {.num = CONFIG_FALSE}},
+    {"features", "tfidf_update", CONFIG_TYPE_BOOL, {.num = CONFIG_FALSE}},
+    {"features", "tfidf_merge", CONFIG_TYPE_STRING, {.str = ""}},
+    {"features", "vocab_file", CONFIG_TYPE_STRING, {.str = ""}},
+    {"features", "vocab_size", CONFIG_TYPE_INT, {.num = 65536}},
+    {"features", "dict_file", CONFIG_TYPE_STRING, {.str = ""}},
+    {"features", "select_file", CONFIG_TYPE_STRING, {.str = ""}},
+    {"features", "select_method", CONFIG_TYPE_STRING, {.str = "chi2"}},
+    {"features", "select_num", CONFIG_TYPE_INT, {.num = 4096}},
+    {"features", "window_len", CONFIG_TYPE_INT, {.num = 0}},
+    {"features", "window_stride", CONFIG_TYPE_INT, {.num = 0}},
     {"filter", "dim_reduce", CONFIG_TYPE_STRING, {.str = "none" }},
     {"filter", "dim_num", CONFIG_TYPE_INT, {.num = 32}},
     {"filter", "bloom_num", CONFIG_TYPE_INT, {.num = 2}},
+    {"filter", "minhash_oph", CONFIG_TYPE_BOOL, {.num = CONFIG_FALSE}},
+    {"filter", "randproj_sparsity", CONFIG_TYPE_INT, {.num = 3}},
+    {"filter", "pca_file", CONFIG_TYPE_STRING, {.str = ""}},
+    {"filter", "pca_sketch", CONFIG_TYPE_INT, {.num = 256}},
+    {"filter", "group_regex", CONFIG_TYPE_STRING, {.str = ""}},
+    {"filter", "group_source", CONFIG_TYPE_BOOL, {.num = CONFIG_FALSE}},
+    {"filter", "group_window", CONFIG_TYPE_INT, {.num = 0}},
     {"output", "output_format", CONFIG_TYPE_STRING, {.str = "libsvm"}},
     {"output", "skip_null", CONFIG_TYPE_BOOL, {.num = CONFIG_FALSE}},
+    {"output", "lsh_bands", CONFIG_TYPE_INT, {.num = 8}},
+    {"output", "lsh_mode", CONFIG_TYPE_STRING, {.str = "pairs"}},
+    {"output", "matrix_kernel", CONFIG_TYPE_STRING, {.str = "dot"}},
+    {"output", "knn_file", CONFIG_TYPE_STRING, {.str = ""}},
+    {"output", "knn_num", CONFIG_TYPE_INT, {.num = 5}},
+    {"output", "knn_kernel", CONFIG_TYPE_STRING, {.str = "dot"}},
+    {"output", "score_model", CONFIG_TYPE_STRING, {.str = ""}},
+    {"output", "score_bias", CONFIG_TYPE_FLOAT, {.flt = 0}},
     {NULL}
 };
 
@@ -221,10 +249,10 @@ static void config_default(config_t *cfg)
  */
 int config_check(config_t *cfg)
 {
-    const char *s1, *s2;
+    const char *s1, *s2, *s3;
     double f1, f2;
     int i1;
-    cfg_int n;
+    cfg_int n, m;
 
     /* Add default values where missing */
     config_default(cfg);
@@ -257,6 +285,27 @@ int config_check(config_t *cfg)
         return 0;
     }
 
+    config_lookup_string(cfg, "features.vect_enc", &s1);
+    if (fvec_enc_parse(s1) != FVEC_ENC_FLOAT) {
+        config_lookup_string(cfg, "features.vect_embed", &s2);
+        config_lookup_string(cfg, "features.vect_norm", &s3);
+        config_lookup_bool(cfg, "features.vect_sign", &i1);
+        if (!strcasecmp(s2, "tfidf") || strcasecmp(s3, "none") || i1) {
+            error("Encoding '%s' requires unsigned counts without "
+                  "normalization.", s1);
+            return 0;
+        }
+    } else if (strcasecmp(s1, "auto")) {
+        error("Unknown value encoding '%s'.", s1);
+        return 0;
+    }
+
+    config_lookup_int(cfg, "features.hash_bits", &n);
+    if (n <= 0 || n > FEAT_BITS) {
+        error("Number of hash bits must be between 1 and %d.", FEAT_BITS);
+        return 0;
+    }
+
     config_lookup_string(cfg, "features.hash_file", &s1);
     config_lookup_bool(cfg, "features.explicit_hash", &i1);
     if (i1 && strlen(s1) > 0) {
@@ -264,6 +313,77 @@ int config_check(config_t *cfg)
         return 0;
     }
 
+    config_lookup_string(cfg, "features.vocab_file", &s2);
+    config_lookup_int(cfg, "features.vocab_size", &n);
+    if (strlen(s2) > 0 && n <= 0) {
+        error("Size of vocabulary must be positive.");
+        return 0;
+    }
+    if (strlen(s2) > 0 && (i1 || strlen(s1) > 0)) {
+        error("A vocabulary can not be used with an explicit hash table.");
+        return 0;
+    }
+
+    config_lookup_string(cfg, "features.dict_file", &s2);
+    if (strlen(s2) > 0 && (i1 || strlen(s1) > 0)) {
+        error("A dictionary can not be used with an explicit hash table.");
+        return 0;
+    }
+
+    config_lookup_string(cfg, "features.select_file", &s2);
+    config_lookup_string(cfg, "features.select_method", &s1);
+    config_lookup_int(cfg, "features.select_num", &n);
+    if (strcasecmp(s1, "chi2") && strcasecmp(s1, "mi")) {
+        error("Unknown method for feature selection '%s'.", s1);
+        return 0;
+    }
+    if (strlen(s2) > 0 && n <= 0) {
+        error("Number of selected features must be positive.");
+        return 0;
+    }
+
+    config_lookup_int(cfg, "features.window_len", &n);
+    config_lookup_bool(cfg, "features.ngram_pos", &i1);
+    if (n < 0) {
+        error("Length of sliding window must not be negative.");
+        return 0;
+    }
+    if (n > 0 && i1) {
+        error("Positional n-grams can not be used with sliding windows.");
+        return 0;
+    }
+
+    config_lookup_int(cfg, "features.window_stride", &n);
+    if (n < 0) {
+        error("Stride of sliding window must not be negative.");
+        return 0;
+    }
+
+    config_lookup_int(cfg, "filter.randproj_sparsity", &n);
+    if (n < 1) {
+        error("Sparsity of random projection must be at least 1.");
+        return 0;
+    }
+
+    config_lookup_int(cfg, "filter.pca_sketch", &n);
+    if (n < 1) {
+        error("Size of sketch for PCA must be positive.");
+        return 0;
+    }
+
+    config_lookup_string(cfg, "filter.dim_reduce", &s1);
+    config_lookup_int(cfg, "filter.dim_num", &m);
+    if (!strcasecmp(s1, "pca") && m > n) {
+        error("Number of principal components exceeds size of sketch.");
+        return 0;
+    }
+
+    config_lookup_int(cfg, "filter.group_window", &n);
+    if (n < 0) {
+        error("Window of aggregation must not be negative.");
+        return 0;
+    }
+
     return 1;
 }
 
@@ -323,22 +323,78 @@ int strip_newline(char *str, int len)
     return k + 1;
 }
 
+/* Precomputed seeds of rehashing */
+static uint64_t rehash_seeds[REHASH_SEEDS];
+static int rehash_ready = FALSE;
+
 /**
- * Rehash using a PRNG.
- * @param f Original hash value
- * @param n Number of rehashing steps
- * @return New hash value
+ * Precomputes the seeds of the first rehashing rounds. The table is
+ * filled once and only read afterwards, hence this function needs to be
+ * called before any parallel region.
  */
-uint64_t rehash(uint64_t f, int n)
+void rehash_init()
 {
+    unsigned short seed[3] = { 0xdead, 0xc0de, 0xbabe };
     uint64_t r = 0;
+    int i;
+
+    if (rehash_ready)
+        return;
+
+    for (i = 0; i < REHASH_SEEDS; i++) {
+        rehash_seeds[i] = r;
+        r = (((uint64_t) nrand48(seed)) << 32) + nrand48(seed);
+    }
+    rehash_ready = TRUE;
+}
+
+/**
+ * Returns the seed of a rehashing round. The seeds of the first rounds
+ * are taken from the table of rehash_init(), such that rehashing takes
+ * constant time. Without the table each seed is computed.
+ * @param n Number of rehashing steps
+ * @return Seed of round
+ */
+uint64_t rehash_seed(int n)
+{
     unsigned short seed[3] = { 0xdead, 0xc0de, 0xbabe };
+    uint64_t r = 0;
     int i;
 
+    if (rehash_ready && n < REHASH_SEEDS)
+        return rehash_seeds[n];
+
+    /* Rounds beyond the table need to be computed */
     for (i = 0; i < n; i++)
         r = (((uint64_t) nrand48(seed)) << 32) + nrand48(seed);
 
-    return f ^ r;
+    return r;
+}
+
+/**
+ * Rehash using a PRNG.
+ * @param f Original hash value
+ * @param n Number of rehashing steps
+ * @return New hash value
+ */
+uint64_t rehash(uint64_t f, int n)
+{
+    return f ^ rehash_seed(n);
+}
+
+/**
+ * Mixes the bits of a hash value (finalizer of MurmurHash3).
+ * @param x Hash value
+ * @return Mixed hash value
+ */
+uint64_t hash_mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
 }
 
 /** @} */
@@ -23,6 +23,9 @@
 #define PROGBAR_DONE    '#'
 #define PROGBAR_FRONT   '|'
 
+/* Number of precomputed rehashing rounds */
+#define REHASH_SEEDS    1024
+
 /* Fatal message */
 #ifndef fatal
 #define fatal(...)     {err_msg("Error", __func__, __VA_ARGS__); exit(-1);}
@@ -47,5 +50,8 @@ int decode_str(char *str);
 uint64_t hash_str(char *s, int l);
 int strip_newline(char *s, int l);
 uint64_t rehash(uint64_t f, int n);
+void rehash_init();
+uint64_t rehash_seed(int n);
+uint64_t hash_mix(uint64_t x);
 
 #endif /* UTIL_H */
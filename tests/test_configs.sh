@@ -29,6 +29,26 @@ for CONFIG in config1.cfg config2.cfg config3.cfg ; do
     $SALLY -c $SRCDIR/tests/$CONFIG $DATA - | grep -v -E '^#' >> $OUTPUT
 done
 
+# Candidates of LSH for duplicated strings are written to a file
+echo config4.cfg >> $OUTPUT
+cat $DATA $DATA > $OUTPUT.in
+$SALLY -c $SRCDIR/tests/config4.cfg $OUTPUT.in $OUTPUT.lsh
+grep -v -E '^#' $OUTPUT.lsh >> $OUTPUT
+rm -f $OUTPUT.in $OUTPUT.lsh $OUTPUT.lsh.meta
+
+# Scores of a small linear model over the 8 dimensions of bytes
+echo config5.cfg >> $OUTPUT
+cat > score.fv << EOF
+fvec: len=4, total=0, label=0.0000000000, src=(null)
+  feat=0000000000000001:0.5000000000
+  feat=0000000000000003:-1.0000000000
+  feat=0000000000000004:2.0000000000
+  feat=0000000000000006:0.2500000000
+EOF
+$SALLY -c $SRCDIR/tests/config5.cfg $DATA $OUTPUT.score
+grep -v -E '^#' $OUTPUT.score >> $OUTPUT
+rm -f score.fv $OUTPUT.score
+
 # Save output
 #cp $OUTPUT /tmp/test_configs.txt
 
@@ -17,9 +17,16 @@
 #include "input.h"
 #include "sconfig.h"
 #include "embed.h"
+#include "vocab.h"
+#include "fselect.h"
 
 /* Test file */
 #define TEST_TFIDF              "test.fv"
+#define TEST_VOCAB              "vocab.fv"
+#define TEST_SELECT             "select.fv"
+#define TEST_LABELS             "labels.txt"
+#define TEST_TOKENS             "tokens.txt"
+#define TEST_STOP               "stop.txt"
 
 /* Global variables */
 int verbose = 0;
@@ -89,6 +96,119 @@ int test_embed_tfidf()
     return err;
 }
 
+/* 
+ * A test for updating stored document frequencies
+ */
+int test_embed_update()
+{
+    int i, n, err = 0;
+    string_t strs[10];
+
+    config_set_string(&cfg, "features.tfidf_file", TEST_TFIDF);
+    unlink(TEST_TFIDF);
+
+    test_printf("Testing update of document frequencies");
+
+    input_config("lines");
+    char *test_file = getenv("TEST_FILE");
+    n = input_open(test_file);
+    input_read(strs, n);
+
+    /* Compute IDF manually */
+    config_set_string(&cfg, "features.vect_embed", "bin");
+    fvec_t *w = fvec_zero();
+    for (i = 0; i < n; i++) {
+        fvec_t *fv = fvec_extract(strs[i].str, strs[i].len);
+        fvec_add(w, fv);
+        fvec_destroy(fv);
+    }
+    fvec_invert(w);
+    fvec_mul(w, n);
+    fvec_log2(w);
+
+    input_free(strs, n);
+    input_close();
+
+    /* Counting the input twice does not change the weights */
+    config_set_bool(&cfg, "features.tfidf_update", CONFIG_TRUE);
+    for (i = 0; i < 3; i++) {
+        idf_create(test_file);
+        err += !idf_check(w);
+        idf_destroy();
+    }
+
+    /* Load store without update */
+    config_set_bool(&cfg, "features.tfidf_update", CONFIG_FALSE);
+    idf_create(test_file);
+    err += !idf_check(w);
+    idf_destroy();
+    test_return(err, 4);
+
+    fvec_destroy(w);
+    unlink(TEST_TFIDF);
+
+    return err;
+}
+
+/* 
+ * A test for single-pass TFIDF weighting with a spill file
+ */
+int test_embed_spill()
+{
+    int i, n, err = 0;
+    string_t strs[10];
+    fvec_t *x[10], *y[10];
+
+    config_set_string(&cfg, "features.vect_norm", "none");
+    config_set_string(&cfg, "features.vect_embed", "tfidf");
+    config_set_string(&cfg, "features.tfidf_file", TEST_TFIDF);
+    unlink(TEST_TFIDF);
+
+    test_printf("Testing single-pass TFIDF embedding");
+
+    input_config("lines");
+    char *test_file = getenv("TEST_FILE");
+    n = input_open(test_file);
+    input_read(strs, n);
+
+    /* Spill raw vectors */
+    idf_spill_open();
+    for (i = 0; i < n; i++)
+        x[i] = fvec_extract_intern(strs[i].str, strs[i].len);
+    idf_spill_write(x, n);
+    for (i = 0; i < n; i++)
+        fvec_destroy(x[i]);
+
+    /* Read back and compare with regular embedding */
+    idf_spill_rewind(n);
+    if (idf_spill_read(y, n) != n) {
+        test_error("(%d) could not read spilled vectors", n);
+        err++;
+        n = 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        fvec_postprocess(y[i]);
+        x[i] = fvec_extract(strs[i].str, strs[i].len);
+        if (!fvec_equals(x[i], y[i])) {
+            test_error("(%d) spilled vector differs", i);
+            err++;
+        }
+        fvec_destroy(x[i]);
+        fvec_destroy(y[i]);
+    }
+    test_return(err, n);
+
+    idf_spill_close();
+    input_free(strs, n);
+    input_close();
+
+    idf_destroy();
+    unlink(TEST_TFIDF);
+
+    return err;
+}
+
 /* 
  * A simple test for the binary embedding
  */
@@ -181,6 +301,157 @@ int test_norm_l1()
     return err;
 }
 
+/* 
+ * A test of the mapping to a vocabulary of frequent features
+ */
+int test_embed_vocab()
+{
+    int i, j, k, n, err = 0;
+    int sizes[] = { 1 << 16, 4 };
+    string_t strs[10];
+    fvec_t *fv, *fx;
+    FILE *f;
+
+    test_printf("Testing vocabulary of features");
+    config_set_string(&cfg, "features.vect_embed", "cnt");
+    config_set_string(&cfg, "features.vect_norm", "none");
+    config_set_string(&cfg, "features.vocab_file", TEST_VOCAB);
+    char *test_file = getenv("TEST_FILE");
+
+    for (k = 0; k < 2; k++) {
+        unlink(TEST_VOCAB);
+        config_set_int(&cfg, "features.vocab_size", sizes[k]);
+        vocab_create(test_file);
+
+        input_config("lines");
+        n = input_open(test_file);
+        input_read(strs, n);
+
+        for (i = 0; i < n; i++) {
+            fv = fvec_extract(strs[i].str, strs[i].len);
+            for (j = 0; j < fv->len; j++)
+                err += fv->dim[j] >= vocab_size();
+
+            /* All features are kept for a large vocabulary */
+            vocab_destroy();
+            fx = fvec_extract(strs[i].str, strs[i].len);
+            err += k == 0 && fx->len != fv->len;
+            fvec_destroy(fx);
+            fvec_destroy(fv);
+            vocab_create(test_file);
+        }
+        err += vocab_size() > sizes[k];
+
+        input_free(strs, n);
+        input_close();
+        vocab_destroy();
+    }
+
+    /* The most frequent token is selected, unless it is a stop token */
+    fvec_delim_set(" ");
+    f = fopen(TEST_TOKENS, "w");
+    fprintf(f, "the cat\nthe dog\nthe cow\nthe cat\n");
+    fclose(f);
+    f = fopen(TEST_STOP, "w");
+    fprintf(f, "the\n");
+    fclose(f);
+
+    config_set_int(&cfg, "features.vocab_size", 1);
+    for (k = 0; k < 2; k++) {
+        unlink(TEST_VOCAB);
+        if (k)
+            stoptokens_load(TEST_STOP);
+        vocab_create(TEST_TOKENS);
+        err += vocab_size() != 1;
+
+        fv = fvec_extract(k ? "cat" : "the", 3);
+        err += fv->len != 1 || fv->dim[0] != 0;
+        fvec_destroy(fv);
+        fv = fvec_extract(k ? "the dog" : "cat dog", 7);
+        err += fv->len != 0;
+        fvec_destroy(fv);
+        vocab_destroy();
+    }
+
+    stoptokens_destroy();
+    fvec_delim_reset();
+    config_set_string(&cfg, "features.vocab_file", "");
+    unlink(TEST_VOCAB);
+    unlink(TEST_TOKENS);
+    unlink(TEST_STOP);
+    test_return(err, 2 * n + 4);
+    return err;
+}
+
+/* 
+ * A test of the label-aware feature selection
+ */
+int test_embed_select()
+{
+    int i, k, err = 0;
+    char *methods[] = { "chi2", "mi" };
+    fvec_t *fv, *fp, *fn;
+    FILE *f;
+
+    test_printf("Testing selection of features");
+    config_set_string(&cfg, "features.vect_embed", "cnt");
+    config_set_string(&cfg, "features.vect_norm", "none");
+    config_set_string(&cfg, "features.select_file", TEST_SELECT);
+    config_set_int(&cfg, "features.select_num", 2);
+    fvec_delim_set(" ");
+
+    /* Only the tokens "pos" and "neg" depend on the label */
+    f = fopen(TEST_LABELS, "w");
+    for (i = 0; i < 20; i++)
+        fprintf(f, "%s\n", i % 2 ? "1 pos x y" : "-1 neg y x");
+    fclose(f);
+
+    fp = fvec_extract("pos", 3);
+    fn = fvec_extract("neg", 3);
+
+    for (k = 0; k < 2; k++) {
+        unlink(TEST_SELECT);
+        config_set_string(&cfg, "features.select_method", methods[k]);
+        fselect_create(TEST_LABELS);
+        err += fselect_size() != 2;
+
+        fv = fvec_extract("x neg y pos", 11);
+        err += fv->len != 2;
+        err += fv->len == 2 && fv->dim[0] != fp->dim[0] &&
+            fv->dim[0] != fn->dim[0];
+        err += fv->len == 2 && fv->dim[1] != fp->dim[0] &&
+            fv->dim[1] != fn->dim[0];
+        fvec_destroy(fv);
+        fselect_destroy();
+    }
+
+    /* Stop tokens are not selected */
+    f = fopen(TEST_STOP, "w");
+    fprintf(f, "pos\n");
+    fclose(f);
+    stoptokens_load(TEST_STOP);
+
+    unlink(TEST_SELECT);
+    fselect_create(TEST_LABELS);
+    fv = fvec_extract("x neg y pos", 11);
+    err += fv->len != 2;
+    err += fv->len == 2 && (fv->dim[0] == fp->dim[0] ||
+                            fv->dim[1] == fp->dim[0]);
+    fvec_destroy(fv);
+    fselect_destroy();
+    stoptokens_destroy();
+
+    fvec_destroy(fp);
+    fvec_destroy(fn);
+    fvec_delim_reset();
+    config_set_string(&cfg, "features.select_file", "");
+    unlink(TEST_SELECT);
+    unlink(TEST_LABELS);
+    unlink(TEST_STOP);
+    test_return(err, 10);
+    return err;
+}
+
 /**
  * Main function
  */
@@ -200,7 +471,11 @@ int main(int argc, char **argv)
     err |= test_norm_l1();
     err |= test_norm_l2();
     err |= test_embed_tfidf();
+    err |= test_embed_update();
+    err |= test_embed_spill();
     err |= test_embed_bin();
+    err |= test_embed_vocab();
+    err |= test_embed_select();
 
     return err;
 }
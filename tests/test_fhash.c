@@ -12,10 +12,14 @@
 #include "config.h"
 #include "common.h"
 #include "fhash.h"
+#include "fdict.h"
+#include "util.h"
 #include "tests.h"
 
 /* Test file */
 #define TEST_FILE               "test.fh"
+/* Test dictionary */
+#define TEST_DICT               "test.dt"
 /* Number of stress runs */
 #define STRESS_RUNS             4096
 /* String length */
@@ -166,6 +170,56 @@ int test_read_write()
     return (err > 0);
 }
 
+/* 
+ * A test for interning, saving and mapping the dictionary of features
+ */
+int test_dict()
+{
+    int i, j, l, err = 0;
+    char *s, buf[32];
+    feat_t id;
+
+    test_printf("Interning and mapping of feature dictionary");
+
+    /* Intern features twice */
+    unlink(TEST_DICT);
+    fdict_init(TEST_DICT);
+    for (j = 0; j < 2; j++) {
+        for (i = 0; tests[i].s != 0; i++) {
+            s = tests[i].s;
+            id = fdict_id(s, strlen(s), hash_str(s, strlen(s)));
+            err += (id != (feat_t) i);
+        }
+    }
+    err += (fdict_size() != (unsigned long) i);
+    fdict_destroy();
+
+    /* Map dictionary and check features */
+    fdict_init(TEST_DICT);
+    for (i = 0; tests[i].s != 0; i++) {
+        s = tests[i].s;
+        id = fdict_id(s, strlen(s), hash_str(s, strlen(s)));
+        err += (id != (feat_t) i);
+
+        s = fdict_get(id, &l);
+        if (!s || l != strlen(tests[i].s) || memcmp(s, tests[i].s, l)) {
+            test_error("(%d) wrong string for feature", i);
+            err++;
+        }
+    }
+
+    /* Unknown features are not added */
+    snprintf(buf, sizeof(buf), "x y z");
+    id = fdict_id(buf, strlen(buf), hash_str(buf, strlen(buf)));
+    err += (id != FDICT_NONE);
+    err += (fdict_size() != (unsigned long) i);
+
+    fdict_destroy();
+    unlink(TEST_DICT);
+
+    test_return(err, 3 * i + 2);
+    return (err > 0);
+}
 
 /**
  * Main function
@@ -177,6 +231,7 @@ int main(int argc, char **argv)
     err |= test_static();
     err |= test_stress();
     err |= test_read_write();
+    err |= test_dict();
 
     return err;
 }
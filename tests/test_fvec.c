@@ -14,6 +14,13 @@
 #include "sally.h"
 #include "fvec.h"
 #include "fhash.h"
+#include "fzvec.h"
+#include "fmask.h"
+#include "fgroup.h"
+#include "fwindow.h"
+#include "fpca.h"
+#include "reduce.h"
+#include "fmath.h"
 #include "sconfig.h"
 
 /* Global variables */
@@ -185,6 +192,32 @@ int test_arithmetic()
 
     fvec_destroy(fc);
 
+    /* Repeated addition with growing memory */ i++;
+    fc = fvec_clone(fa);
+    fd = fvec_clone(fa);
+    fvec_mul(fd, 3.0);
+
+    fvec_add(fc, fb);
+    fvec_add(fc, fa);
+    fvec_add(fc, fb);
+    fvec_add(fc, fa);
+    fvec_mul(fb, 2.0);
+    fvec_add(fd, fb);
+    fvec_mul(fb, 0.5);
+    if (!fvec_equals(fc, fd) || fc->size < fc->len) {
+        err++;
+        test_error("(%d) repeated addition failed!", i);
+    }
+
+    fvec_shrink(fc);
+    if (fc->size != fc->len || !fvec_equals(fc, fd)) {
+        err++;
+        test_error("(%d) shrinking failed!", i);
+    }
+
+    fvec_destroy(fc);
+    fvec_destroy(fd);
+
     /* Dot product with an empty feature vector */ i++;
     d1 = fvec_dot(empty, fa);
     d2 = fvec_dot(fa, empty);
@@ -351,6 +384,502 @@ int test_read_write()
     return err;
 }
 
+/* 
+ * Creates a random sparse vector for testing intersections
+ */
+static fvec_t *random_fvec(int len, int range)
+{
+    int i;
+    fvec_t *f = fvec_zero();
+
+    fvec_reserve(f, len);
+    for (i = 0; i < len; i++) {
+        f->dim[i] = (i > 0 ? f->dim[i - 1] : 0) + rand() % range + 1;
+        f->val[i] = (rand() % 100) / 10.0 + 0.1;
+    }
+    f->len = len;
+    return f;
+}
+
+/* 
+ * A test of the intersection kernels for vectors of different sizes
+ */
+int test_intersect()
+{
+    int i, j, k, err = 0;
+    int lens[] = { 1, 3, 7, 50, 200, 3000 };
+    int n = sizeof(lens) / sizeof(int);
+
+    test_printf("Intersections of feature vectors");
+
+    for (i = 0; i < n * n * 4; i++) {
+        fvec_t *fa = random_fvec(lens[i % n], 1 + i % 4 * 5);
+        fvec_t *fb = random_fvec(lens[(i / n) % n], 1 + i % 3 * 20);
+        double s = 0;
+
+        /* Reference results */
+        fvec_t *fc = fvec_clone(fa);
+        for (j = 0; j < fc->len; j++) {
+            float v = 0;
+            for (k = 0; k < fb->len; k++)
+                if (fb->dim[k] == fc->dim[j])
+                    v = fb->val[k];
+            s += fa->val[j] * v;
+            fc->val[j] *= v;
+        }
+        fvec_sparsify(fc);
+
+        err += fabs(fvec_dot(fa, fb) - s) > 1e-6;
+        err += fabs(fvec_dot(fb, fa) - s) > 1e-6;
+
+        fvec_times(fa, fb);
+        err += !fvec_equals(fa, fc);
+
+        fvec_destroy(fa);
+        fvec_destroy(fb);
+        fvec_destroy(fc);
+    }
+
+    test_return(err, n * n * 4);
+    return err;
+}
+
+/* 
+ * A test of compressed vectors and their dot product and addition
+ */
+int test_compress()
+{
+    int i, err = 0;
+    int lens[] = { 0, 1, 7, 200, 3000 };
+    int ranges[] = { 1, 100, 1 << 20 };
+    int n = sizeof(lens) / sizeof(int), m = sizeof(ranges) / sizeof(int);
+    fzset_t *zs = fzset_create();
+    fzvec_t zv;
+
+    test_printf("Compression of feature vectors");
+
+    for (i = 0; i < n * m; i++) {
+        fvec_t *fa = random_fvec(lens[i % n], ranges[i % m]);
+        fvec_t *fb = random_fvec(lens[(i / m) % n], ranges[(i / n) % m]);
+        fzvec_t *za = fzvec_compress(fa);
+        fvec_t *fc = fzvec_expand(za);
+
+        err += !fvec_equals(fa, fc);
+        err += fabs(fzvec_dot(za, fb) - fvec_dot(fa, fb)) > 1e-6;
+
+        /* Addition of compressed to regular vector */
+        fvec_destroy(fc);
+        fc = fvec_clone(fb);
+        fvec_add(fb, fa);
+        fzvec_add(fc, za);
+        err += !fvec_equals(fb, fc);
+
+        /* Vectors in a set */
+        fzset_add(zs, fa);
+        fzset_get(zs, i, &zv);
+        err += fabs(fzvec_dot(&zv, fb) - fvec_dot(fa, fb)) > 1e-6;
+
+        fzvec_destroy(za);
+        fvec_destroy(fa);
+        fvec_destroy(fb);
+        fvec_destroy(fc);
+    }
+    fzset_destroy(zs);
+
+    test_return(err, n * m * 4);
+    return err;
+}
+
+/* 
+ * A read and write test of the binary format with value encodings
+ */
+int test_read_write_bin()
+{
+    int i, j, err = 0;
+    float vals[] = { 1, 1, 200, 65535, 2.5 };
+    int encs[] = { FVEC_ENC_ONE, FVEC_ENC_ONE, FVEC_ENC_UINT8,
+        FVEC_ENC_UINT16, FVEC_ENC_FLOAT
+    };
+    int n = sizeof(encs) / sizeof(int);
+    fvec_t *f[5], *g;
+    gzFile z;
+
+    test_printf("binary format with value encodings");
+
+    /* Create vectors with increasing maximum values */
+    for (i = 0; i < n; i++) {
+        f[i] = random_fvec(i * 1000, 100);
+        for (j = 0; j < f[i]->len; j++)
+            f[i]->val[j] = (j % 2) ? vals[i] : 1;
+        err += fvec_encoding(f[i]) != encs[i];
+    }
+
+    z = gzopen(TEST_FILE, "w9");
+    if (!z) {
+        printf("Could not create file (ignoring)\n");
+        return FALSE;
+    }
+    for (i = 0; i < n; i++)
+        err += !fvec_write_bin(f[i], z);
+    gzclose(z);
+
+    /* Read and compare feature vectors */
+    z = gzopen(TEST_FILE, "r");
+    for (i = 0; i < n; i++) {
+        g = fvec_read_bin(z);
+        err += !g || !fvec_equals(f[i], g);
+        fvec_destroy(g);
+    }
+    err += fvec_read_bin(z) != NULL;
+    gzclose(z);
+
+    /* Dimensions are stored with 64 bits in all builds */
+    uint64_t len = 1, dim = (uint64_t) 1 << 40;
+    uint32_t slen = 0;
+    uint8_t enc = FVEC_ENC_ONE;
+    float label = 0;
+
+    z = gzopen(TEST_FILE, "w9");
+    gzwrite(z, &len, sizeof(len));
+    gzwrite(z, &len, sizeof(len));
+    gzwrite(z, &label, sizeof(label));
+    gzwrite(z, &slen, sizeof(slen));
+    gzwrite(z, &enc, sizeof(enc));
+    gzwrite(z, &dim, sizeof(dim));
+    gzclose(z);
+
+    z = gzopen(TEST_FILE, "r");
+    g = fvec_read_bin(z);
+#ifdef ENABLE_NARROW_DIMS
+    err += g != NULL;
+#else
+    err += !g || g->len != 1 || g->dim[0] != dim;
+#endif
+    fvec_destroy(g);
+    gzclose(z);
+    unlink(TEST_FILE);
+
+    /* Saturate counts */
+    fvec_saturate(f[3], FVEC_ENC_UINT8);
+    err += fvec_encoding(f[3]) != FVEC_ENC_UINT8;
+    fvec_saturate(f[4], FVEC_ENC_UINT16);
+    err += fvec_encoding(f[4]) != FVEC_ENC_UINT8;
+
+    for (i = 0; i < n; i++)
+        fvec_destroy(f[i]);
+
+    test_return(err, 3 * n + 3);
+    return err;
+}
+
+/* 
+ * A test of the early filtering of features during extraction
+ */
+int test_mask()
+{
+    int i, j, err = 0;
+    fvec_t *f, *g, *h;
+
+    test_printf("Filtering of features during extraction");
+
+    for (i = 0; tests[i].str; i++) {
+        init_sally(tests[i]);
+        f = fvec_extract(tests[i].str, strlen(tests[i].str));
+
+        /* Permit every other feature */
+        g = fvec_zero();
+        fvec_reserve(g, f->len);
+        for (j = 0; j < f->len; j += 2)
+            g->dim[g->len++] = f->dim[j];
+        fmask_create(g);
+
+        h = fvec_extract(tests[i].str, strlen(tests[i].str));
+        err += h->len != g->len;
+        for (j = 0; j < h->len && j < g->len; j++)
+            err += h->dim[j] != g->dim[j];
+
+        fmask_destroy();
+        fvec_destroy(f);
+        fvec_destroy(g);
+        fvec_destroy(h);
+    }
+
+    test_return(err, i);
+    return err;
+}
+
+/* 
+ * A test of the aggregation of vectors by group
+ */
+int test_group()
+{
+    int i, err = 0;
+    char *strs[] = { "a1 x", "b2 y", "a3 z", "c x", "b4 y" };
+    char *keys[] = { "a", "b", "c" };
+    fvec_t *f[5], *g[3], **x;
+    long n;
+
+    test_printf("Aggregation of vectors by group");
+
+    fgroup_init("^([a-z]+)[0-9]* ");
+    for (i = 0; i < 3; i++)
+        g[i] = fvec_zero();
+
+    for (i = 0; i < 5; i++) {
+        f[i] = random_fvec(100, 1000);
+        f[i]->src = fgroup_key(strs[i], strlen(strs[i]), NULL);
+        fvec_set_label(f[i], i);
+        fgroup_add(f[i]);
+        fvec_add(g[f[i]->src[0] - 'a'], f[i]);
+    }
+
+    /* Check sums, keys and labels */
+    x = fgroup_flush(&n);
+    err += n != 3;
+    for (i = 0; i < n && i < 3; i++) {
+        err += strcmp(x[i]->src, keys[i]) != 0;
+        err += !fvec_equals(x[i], g[i]);
+    }
+    err += n == 3 && x[0]->label != 2;
+    err += n == 3 && x[1]->label != 4;
+
+    for (i = 0; i < n; i++)
+        fvec_destroy(x[i]);
+    free(x);
+
+    /* Groups are empty after flushing */
+    x = fgroup_flush(&n);
+    err += n != 0;
+    free(x);
+    fgroup_destroy();
+
+    for (i = 0; i < 5; i++)
+        fvec_destroy(f[i]);
+    for (i = 0; i < 3; i++)
+        fvec_destroy(g[i]);
+
+    test_return(err, 10);
+    return err;
+}
+
+/* 
+ * A test of the incremental embedding of sliding windows
+ */
+int test_window()
+{
+    int i, j, k, n, err = 0, runs = 0;
+    int start[STR_LENGTH], end[STR_LENGTH], units, len, s;
+    char str[2 * STR_LENGTH];
+    test_t t[] = { {NULL, "", 1, 0}, {NULL, " ", 1, 0} };
+    fvec_t **x, *f;
+    cfg_int wl, ws;
+    long num;
+
+    test_printf("Incremental embedding of sliding windows");
+
+    for (i = 0; i < 32; i++) {
+        /* Random string of bytes or tokens */
+        t[i % 2].nlen = rand() % 3 + 1;
+        init_sally(t[i % 2]);
+        config_set_bool(&cfg, "features.ngram_blend", rand() % 2);
+        config_set_int(&cfg, "features.window_len", rand() % 20 + 1);
+        config_set_int(&cfg, "features.window_stride", rand() % 8);
+        fwindow_init();
+
+        for (j = 0, len = 0, units = rand() % 100; j < units; j++) {
+            start[j] = len;
+            for (k = rand() % (i % 2 + 1); k >= 0; k--)
+                str[len++] = 'a' + rand() % 4;
+            end[j] = len;
+            if (i % 2)
+                str[len++] = ' ';
+        }
+
+        /* Compare windows with embedding of substrings */
+        x = fwindow_extract(str, len, &num);
+        config_lookup_int(&cfg, "features.window_len", &wl);
+        config_lookup_int(&cfg, "features.window_stride", &ws);
+        n = wl, k = ws > 0 ? ws : wl;
+
+        if (units < n) {
+            err += num != 1;
+            f = fvec_extract_intern(str, len);
+            err += num == 1 && !fvec_equals(x[0], f);
+            fvec_destroy(f);
+        } else {
+            err += num != (units - n) / k + 1;
+            for (j = 0; j < num; j++) {
+                s = j * k;
+                f = fvec_extract_intern(str + start[s],
+                                        end[s + n - 1] - start[s]);
+                err += !fvec_equals(x[j], f);
+                err += x[j]->total != f->total;
+                fvec_destroy(f);
+            }
+        }
+
+        for (j = 0; j < num; j++)
+            fvec_destroy(x[j]);
+        free(x);
+        runs++;
+    }
+
+    config_set_bool(&cfg, "features.ngram_blend", CONFIG_FALSE);
+    config_set_int(&cfg, "features.window_len", 0);
+    config_set_int(&cfg, "features.window_stride", 0);
+    fwindow_init();
+    fvec_delim_reset();
+
+    test_return(err, runs);
+    return err;
+}
+
+/* 
+ * A test of the extraction fused with dimension reduction
+ */
+int test_reduce_fused()
+{
+    int i, j, err = 0;
+    char *methods[] = { "simhash", "minhash", "bloom" };
+    char str[STR_LENGTH];
+    test_t t[] = { {NULL, "", 3, 0}, {NULL, " ", 2, 0} };
+    fvec_t *f, *g;
+
+    test_printf("Extraction fused with dimension reduction");
+
+    config_set_string(&cfg, "features.vect_embed", "bin");
+
+    for (i = 0; i < 48; i++) {
+        init_sally(t[i % 2]);
+        config_set_string(&cfg, "filter.dim_reduce", methods[i % 3]);
+        config_set_int(&cfg, "filter.dim_num", rand() % 256 + 1);
+        config_set_bool(&cfg, "features.ngram_blend", (i / 6) % 2);
+        config_set_bool(&cfg, "filter.minhash_oph", (i / 12) % 2);
+        reduce_init();
+        err += !reduce_fused();
+
+        /* Random string with repeated n-grams */
+        for (j = 0; j < STR_LENGTH / 8 && i % 8; j++)
+            str[j] = rand() % 2 ? ' ' : 'a' + rand() % 4;
+
+        f = reduce_extract(str, j);
+        g = fvec_extract(str, j);
+        dim_reduce(g);
+        err += !fvec_equals(f, g) || f->total != g->total;
+
+        fvec_destroy(f);
+        fvec_destroy(g);
+    }
+
+    config_set_string(&cfg, "features.vect_embed", "cnt");
+    config_set_string(&cfg, "filter.dim_reduce", "none");
+    config_set_bool(&cfg, "features.ngram_blend", CONFIG_FALSE);
+    config_set_bool(&cfg, "filter.minhash_oph", CONFIG_FALSE);
+    reduce_init();
+    err += reduce_fused();
+    fvec_delim_reset();
+
+    test_return(err, 2 * i + 1);
+    return err;
+}
+
+/* 
+ * A test of the preservation of distances by random projection
+ */
+int test_randproj()
+{
+    int i, err = 0;
+    fvec_t *a, *b, *pa, *pb;
+    double d, e;
+
+    test_printf("Distances under random projection");
+
+    for (i = 0; i < 32; i++) {
+        config_set_int(&cfg, "filter.randproj_sparsity", i % 2 ? 3 : 30);
+        a = random_fvec(200, 20);
+        b = random_fvec(200, 20);
+        pa = fvec_clone(a);
+        pb = fvec_clone(b);
+        reduce_randproj(pa, 1024);
+        reduce_randproj(pb, 1024);
+
+        /* Squared distances before and after projection */
+        d = fvec_dot(a, a) + fvec_dot(b, b) - 2 * fvec_dot(a, b);
+        e = fvec_dot(pa, pa) + fvec_dot(pb, pb) - 2 * fvec_dot(pa, pb);
+        err += pa->len != 1024 || fabs(e - d) > 0.25 * d;
+
+        fvec_destroy(a);
+        fvec_destroy(b);
+        fvec_destroy(pa);
+        fvec_destroy(pb);
+    }
+
+    config_set_int(&cfg, "filter.randproj_sparsity", 3);
+
+    test_return(err, i);
+    return err;
+}
+
+/* 
+ * A test of the projection onto principal components
+ */
+int test_pca()
+{
+    int i, err = 0, n = 64;
+    fvec_t *b[3], *x[64], *s[64], *t;
+    double d, e;
+
+    test_printf("Projection onto principal components");
+
+    /* Vectors on a plane with random offset */
+    for (i = 0; i < 3; i++)
+        b[i] = random_fvec(100, 20);
+
+    for (i = 0; i < n; i++) {
+        x[i] = fvec_clone(b[0]);
+        t = fvec_clone(b[1]);
+        fvec_mul(t, rand() % 100 / 10.0 - 5);
+        fvec_add(x[i], t);
+        fvec_destroy(t);
+        t = fvec_clone(b[2]);
+        fvec_mul(t, rand() % 100 / 10.0 - 5);
+        fvec_add(x[i], t);
+        fvec_destroy(t);
+        s[i] = fvec_clone(x[i]);
+    }
+
+    fpca_init(64);
+    fpca_add(x, n);
+    fpca_finish(2);
+
+    /* Two components retain the distances of the sketches */
+    for (i = 0; i < n; i++) {
+        fvec_destroy(x[i]);
+        x[i] = fvec_clone(s[i]);
+        reduce_randproj(s[i], 64);
+        fpca_project(x[i]);
+    }
+
+    for (i = 0; i < n - 1; i++) {
+        d = fvec_dot(s[i], s[i]) + fvec_dot(s[i + 1], s[i + 1]) -
+            2 * fvec_dot(s[i], s[i + 1]);
+        e = fvec_dot(x[i], x[i]) + fvec_dot(x[i + 1], x[i + 1]) -
+            2 * fvec_dot(x[i], x[i + 1]);
+        err += x[i]->len != 2 || fabs(e - d) > 1e-3 * d;
+    }
+
+    for (i = 0; i < n; i++) {
+        fvec_destroy(x[i]);
+        fvec_destroy(s[i]);
+    }
+    for (i = 0; i < 3; i++)
+        fvec_destroy(b[i]);
+    fpca_destroy();
+
+    test_return(err, n - 1);
+    return err;
+}
+
 /**
  * Main function
  */
@@ -364,11 +893,20 @@ int main(int argc, char **argv)
 
     err |= test_static();
     err |= test_arithmetic();
+    err |= test_intersect();
+    err |= test_compress();
     err |= test_stress();
 #ifdef ENABLE_OPENMP
     err |= test_stress_omp();
 #endif
     err |= test_read_write();
+    err |= test_read_write_bin();
+    err |= test_mask();
+    err |= test_group();
+    err |= test_window();
+    err |= test_reduce_fused();
+    err |= test_randproj();
+    err |= test_pca();
 
     config_destroy(&cfg);
     return err;
@@ -0,0 +1,327 @@
+/*
+ * Sally - A Tool for Embedding Strings in Vector Spaces
+ * Copyright (C) 2010 Konrad Rieck (konrad@mlsec.org)
+ * --
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 3 of the License, or (at your
+ * option) any later version.  This program is distributed without any
+ * warranty. See the GNU General Public License for more details.
+ */
+
+#include "tests.h"
+#include "sally.h"
+#include "fvec.h"
+#include "input.h"
+#include "sconfig.h"
+#include "output_matrix.h"
+#include "output_knn.h"
+
+/* Global variables */
+int verbose = 0;
+config_t cfg;
+
+/* Test files */
+#define TEST_STRINGS            "/tests/strings.txt"
+#define TEST_OUTPUT             "test.out"
+#define TEST_META               "test.out.meta"
+#define TEST_REF                "test.fv"
+/* Maximum number of test strings */
+#define MAX_STRINGS             64
+/* Maximum number of test vectors */
+#define MAX_VECTORS             4096
+/* Length of substrings of test strings */
+#define SUB_LENGTH              12
+
+/* Feature vectors of test strings and their substrings */
+static fvec_t *fvecs[MAX_VECTORS];
+static int num = 0;
+
+/*
+ * Loads the test strings and extracts the feature vectors of the
+ * strings and of all their substrings of fixed length. The substrings
+ * overlap, such that many vectors are similar.
+ */
+static int load_strings()
+{
+    string_t strs[MAX_STRINGS];
+    char path[MAX_PATH_LEN], *srcdir = getenv("SRCDIR");
+    int i, j, n;
+
+    snprintf(path, MAX_PATH_LEN, "%s%s", srcdir ? srcdir : "..",
+             TEST_STRINGS);
+
+    input_config("lines");
+    n = input_open(path);
+    if (n <= 0 || n > MAX_STRINGS)
+        return FALSE;
+    n = input_read(strs, n);
+    input_close();
+
+    for (i = 0, num = 0; i < n; i++) {
+        for (j = -1; j + SUB_LENGTH <= strs[i].len && num < MAX_VECTORS;
+             j++, num++) {
+            if (j < 0)
+                fvecs[num] = fvec_extract(strs[i].str, strs[i].len);
+            else
+                fvecs[num] = fvec_extract(strs[i].str + j, SUB_LENGTH);
+            fvec_set_label(fvecs[num], num);
+        }
+    }
+    input_free(strs, n);
+
+    return num > 0;
+}
+
+/*
+ * Creates random sparse vectors with few dimensions and values of
+ * varying magnitude, such that terms differ in their contribution
+ */
+static void random_vectors(int n, int sign)
+{
+    int i, j, l;
+
+    for (num = 0; num < n; num++) {
+        fvecs[num] = fvec_zero();
+        l = rand() % 12 + 1;
+        fvec_reserve(fvecs[num], l);
+        for (j = 0, i = 0; j < l; j++) {
+            i += rand() % 8 + 1;
+            fvecs[num]->dim[j] = i;
+            fvecs[num]->val[j] = (rand() % 100 + 1) / 10.0;
+            if (sign && rand() % 4 == 0)
+                fvecs[num]->val[j] *= -1;
+        }
+        fvecs[num]->len = l;
+        fvec_set_label(fvecs[num], num);
+    }
+}
+
+/*
+ * Frees the test vectors
+ */
+static void free_vectors()
+{
+    int i;
+
+    for (i = 0; i < num; i++)
+        fvec_destroy(fvecs[i]);
+    num = 0;
+}
+
+/*
+ * Computes the similarity of two vectors by brute force
+ */
+static double similarity(fvec_t *a, fvec_t *b, int cosine)
+{
+    double d = fvec_dot(a, b), na, nb;
+
+    if (!cosine)
+        return d;
+
+    na = sqrt(fvec_dot(a, a));
+    nb = sqrt(fvec_dot(b, b));
+    return na > 0 && nb > 0 ? d / (na * nb) : d;
+}
+
+/*
+ * Checks whether two vectors share a dimension
+ */
+static int shared_dims(fvec_t *a, fvec_t *b)
+{
+    unsigned long i = 0, j = 0;
+
+    while (i < a->len && j < b->len) {
+        if (a->dim[i] == b->dim[j])
+            return TRUE;
+        if (a->dim[i] < b->dim[j])
+            i++;
+        else
+            j++;
+    }
+    return FALSE;
+}
+
+/*
+ * Compares scores in descending order (for qsort)
+ */
+static int cmp_score(const void *x, const void *y)
+{
+    double a = *(const double *) x, b = *(const double *) y;
+    return (a < b) - (a > b);
+}
+
+/*
+ * Compares the neighbors of one line of the knn output with a ranking
+ * computed by brute force. The reference set holds the vectors with odd
+ * index, such that a query is not contained in it.
+ */
+static int check_knn(char *line, int i, int k, int cosine)
+{
+    double best[MAX_VECTORS], s, last = HUGE_VAL;
+    int j, r, n = 0, m = 0, err = 0;
+    char *tok, *ptr;
+    float label, score;
+
+    /* Scores of all references sharing a dimension with the query */
+    for (j = 1; j < num; j += 2)
+        if (shared_dims(fvecs[i], fvecs[j]))
+            best[n++] = similarity(fvecs[i], fvecs[j], cosine);
+    qsort(best, n, sizeof(double), cmp_score);
+
+    line[strcspn(line, "\n")] = 0;
+    for (tok = strtok_r(line, ",", &ptr); tok;
+         tok = strtok_r(NULL, ",", &ptr), m++) {
+        if (sscanf(tok, "%d:%g:%g", &r, &label, &score) != 3 ||
+            2 * r + 1 >= num || label != 2 * r + 1 || m >= k || m >= n)
+            return 1;
+
+        /* Score of neighbor, order and rank */
+        s = similarity(fvecs[i], fvecs[2 * r + 1], cosine);
+        err += fabs(score - s) > 1e-5 * fmax(1, fabs(s));
+        err += score > last + 1e-6;
+        err += fabs(score - best[m]) > 1e-5 * fmax(1, fabs(best[m]));
+        last = score;
+    }
+
+    /* All k best references are found */
+    err += m != (n < k ? n : k);
+    return err > 0;
+}
+
+/*
+ * A test of the k-nearest neighbors against a brute-force ranking
+ */
+int test_knn()
+{
+    int i, j, k, err = 0, runs = 0;
+    char *kernels[] = { "dot", "cosine" };
+    char line[4096];
+    gzFile z;
+    FILE *f;
+
+    test_printf("Nearest neighbors of vectors");
+
+    config_set_string(&cfg, "output.knn_file", TEST_REF);
+
+    for (i = 0; i < 16; i++) {
+        /* Signed vectors disable the pruning of the search */
+        config_set_bool(&cfg, "features.vect_sign", i % 2);
+        config_set_string(&cfg, "output.knn_kernel", kernels[(i / 2) % 2]);
+        config_set_int(&cfg, "output.knn_num", (i / 4) % 2 ? 3 : 1);
+        if (i >= 8) {
+            random_vectors(1000, i % 2);
+        } else if (!load_strings()) {
+            err++;
+            continue;
+        }
+
+        /* Reference set of vectors with odd index */
+        z = gzopen(TEST_REF, "w9");
+        for (j = 1; z && j < num; j += 2)
+            err += !fvec_write_bin(fvecs[j], z);
+        if (z)
+            gzclose(z);
+
+        err += !output_knn_open(TEST_OUTPUT);
+        err += !output_knn_write(fvecs, num);
+        output_knn_close();
+
+        f = fopen(TEST_OUTPUT, "r");
+        for (j = 0; f && j < num; j++, runs++) {
+            if (!fgets(line, sizeof(line), f)) {
+                err++;
+                continue;
+            }
+            k = (i / 4) % 2 ? 3 : 1;
+            err += check_knn(line, j, k, (i / 2) % 2);
+        }
+        if (f)
+            fclose(f);
+        free_vectors();
+    }
+
+    config_set_bool(&cfg, "features.vect_sign", CONFIG_FALSE);
+    unlink(TEST_OUTPUT);
+    unlink(TEST_REF);
+
+    test_return(err, runs);
+    return err;
+}
+
+/*
+ * A test of the matrix of dot products and cosine similarities
+ */
+int test_matrix()
+{
+    int i, j, k, err = 0, runs = 0;
+    char *kernels[] = { "dot", "cosine" };
+    uint64_t hdr[2];
+    float v;
+    FILE *f;
+
+    test_printf("Matrix of pairwise similarities");
+
+    if (!load_strings()) {
+        test_error("Could not load test strings");
+        test_return(1, 1);
+        return 1;
+    }
+
+    for (k = 0; k < 2; k++) {
+        config_set_string(&cfg, "output.matrix_kernel", kernels[k]);
+
+        err += !output_matrix_open(TEST_OUTPUT);
+        err += !output_matrix_write(fvecs, num);
+        output_matrix_close();
+
+        /* Read back header and entries */
+        f = fopen(TEST_OUTPUT, "r");
+        if (!f || fread(hdr, sizeof(uint64_t), 2, f) != 2) {
+            test_error("Could not read matrix");
+            err++;
+            continue;
+        }
+        err += hdr[0] != num || hdr[1] != num;
+
+        for (i = 0; i < num; i++) {
+            for (j = 0; j < num; j++) {
+                double s = similarity(fvecs[i], fvecs[j], k);
+                err += fread(&v, sizeof(float), 1, f) != 1 ||
+                    fabs(v - s) > 1e-5 * fmax(1, fabs(s));
+                runs++;
+            }
+        }
+        err += fread(&v, sizeof(float), 1, f) != 0;
+        runs += 2;
+        fclose(f);
+    }
+
+    free_vectors();
+    unlink(TEST_OUTPUT);
+    unlink(TEST_META);
+
+    test_return(err, runs);
+    return err;
+}
+
+/**
+ * Main function
+ */
+int main(int argc, char **argv)
+{
+    int err = FALSE;
+
+    /* Create config */
+    config_init(&cfg);
+    config_check(&cfg);
+
+    config_set_string(&cfg, "features.granularity", "bytes");
+    config_set_int(&cfg, "features.ngram_len", 3);
+
+    err |= test_matrix();
+    err |= test_knn();
+
+    config_destroy(&cfg);
+    return err;
+}